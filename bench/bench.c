@@ -0,0 +1,187 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * All benchmarks, the daemon ones before config: readConfig replaces the config
+ * the daemon was set up with
+ * ----------------------------------------------------------------------------------- */
+static const benchmark_t benchmarks[] = {
+    { "json",     &benchJson },
+    { "buttons",  &benchButtons },
+    { "mqtt",     &benchMqtt },
+    { "sequence", &benchSequence },
+    { "log",      &benchLog },
+    { "config",   &benchConfig },
+    { NULL,   NULL },
+};
+
+/* ----------------------------------------------------------------------------------- *
+ * Results, written to the result file at the end
+ * ----------------------------------------------------------------------------------- */
+typedef struct result_t {
+    const char    *name;
+    unsigned long  ops;
+    double         nsPerOp;
+    double         allocsPerOp;
+} result_t;
+
+static result_t results[BENCH_MAX_RESULTS];
+static int      numResults = 0;
+
+/* ----------------------------------------------------------------------------------- *
+ * Allocation counter, the bench is linked with -Wl,--wrap for malloc, calloc and
+ * realloc. Allocations inside libc (fopen, strdup ...) are not seen.
+ * ----------------------------------------------------------------------------------- */
+static atomic_ulong allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc( size_t size ) {
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc( size_t num, size_t size ) {
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc( void *ptr, size_t size ) {
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+uint64_t benchAllocs( void ) {
+    return atomic_load_explicit(&allocs, memory_order_relaxed);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Monotonic time in nano seconds
+ * ----------------------------------------------------------------------------------- */
+uint64_t benchClock( void ) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Print result of a benchmark and keep it for the result file
+ * ----------------------------------------------------------------------------------- */
+void benchReport( const char *name, unsigned long ops, uint64_t elapsed, uint64_t allocs ) {
+    double nsPerOp     = ops ? (double)elapsed / ops : 0.0;
+    double opsPerSec   = elapsed ? ops * 1e9 / elapsed : 0.0;
+    double allocsPerOp = ops ? (double)allocs / ops : 0.0;
+    printf("%-36s %10lu ops %10.1f ns/op %12.0f ops/s %8.3f allocs/op\n",
+           name, ops, nsPerOp, opsPerSec, allocsPerOp);
+
+    if ( numResults < BENCH_MAX_RESULTS ) {
+        results[numResults++] = (result_t){ name, ops, nsPerOp, allocsPerOp };
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Send stdout to /dev/null while the workload writes log messages, and back
+ * ----------------------------------------------------------------------------------- */
+void benchQuiet( bool quiet ) {
+    static int saved = -1;
+
+    fflush(stdout);
+    if ( quiet && saved < 0 ) {
+        int null = open("/dev/null", O_WRONLY);
+        if ( null >= 0 ) {
+            saved = dup(STDOUT_FILENO);
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+    } else if ( !quiet && saved >= 0 ) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        saved = -1;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Write results as JSON, one object per benchmark, to compare builds with
+ * ----------------------------------------------------------------------------------- */
+static bool writeResults( const char *fileName ) {
+    FILE *fp = fopen(fileName, "w");
+    if ( !fp ) {
+        printf("can't create %s\n", fileName);
+        return false;
+    }
+    fprintf(fp, "{\n  \"timestamp\": %ld,\n  \"results\": [\n", (long)time(NULL));
+    for ( int idx=0; idx<numResults; idx++ ) {
+        fprintf(fp, "    {\"name\": \"%s\", \"ops\": %lu, \"ns_per_op\": %.1f, \"allocs_per_op\": %.3f}%s\n",
+                results[idx].name, results[idx].ops, results[idx].nsPerOp, results[idx].allocsPerOp,
+                idx+1 < numResults ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    return fclose(fp) == 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Main: run all benchmarks, or those whose name starts with one of the arguments.
+ * '-o <file>' writes the results to <file> as well.
+ * ----------------------------------------------------------------------------------- */
+int main( int argc, char *argv[] ) {
+    const char *resultFile = NULL;
+    int         filters    = 0;
+
+    for ( int arg=1; arg<argc; arg++ ) {
+        if ( !strcmp(argv[arg], "-o") && arg+1<argc ) {
+            resultFile = argv[++arg];
+        } else {
+            filters++;
+        }
+    }
+
+    // errors on stdout, the daemon benchmarks don't log below that
+    initLog(false);
+    setLogLevel(LOG_WARNING);
+
+    for ( const benchmark_t *bench=benchmarks; bench->name; bench++ ) {
+        bool selected = (filters == 0);
+        for ( int arg=1; arg<argc; arg++ ) {
+            if ( !strcmp(argv[arg], "-o") ) {
+                arg++;
+            } else if ( !strncmp(bench->name, argv[arg], strlen(argv[arg])) ) {
+                selected = true;
+            }
+        }
+        if ( selected ) {
+            bench->run();
+        }
+    }
+
+    if ( resultFile && !writeResults(resultFile) ) {
+        return 1;
+    }
+    return 0;
+}
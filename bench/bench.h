@@ -0,0 +1,58 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifndef bench_h
+#define bench_h
+
+/* ----------------------------------------------------------------------------------- *
+ * A benchmark runs its workload, measures it with benchClock and benchAllocs and
+ * calls benchReport
+ * ----------------------------------------------------------------------------------- */
+typedef struct benchmark_t {
+    const char *name;            // name used to select benchmarks on the command line
+    void      (*run)(void);      // workload
+} benchmark_t;
+
+#define BENCH_MAX_RESULTS  64    // results kept for the result file
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+uint64_t benchClock(void);                                     // monotonic time in ns
+uint64_t benchAllocs(void);                                    // malloc, calloc, realloc so far
+void     benchReport(const char *name, unsigned long ops, uint64_t elapsed, uint64_t allocs);
+void     benchQuiet(bool quiet);                               // send stdout to /dev/null
+
+// daemon with simulated IO extender and MQTT without broker, set up on first use
+bool     benchDaemon(void);
+void     benchFlush(void);                                     // send queued button states
+void     benchWaitPublished(unsigned long expected);           // until the stub got them
+extern atomic_ulong benchPublished;                            // messages passed to "broker"
+
+// benchmarks
+void benchJson(void);
+void benchButtons(void);
+void benchMqtt(void);
+void benchSequence(void);
+void benchLog(void);
+void benchConfig(void);
+
+#endif /* bench_h */
@@ -0,0 +1,108 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+
+#include "bench.h"
+#include "yardControl.h"
+#include "pushButton.h"
+#include "hardware.h"
+#include "hwSimulator.h"
+
+#define ROUNDS     1000000
+#define EDGE_EVERY 4             // samples between button press and release
+
+/* ----------------------------------------------------------------------------------- *
+ * Press or release button of zone, on the simulated expander
+ * ----------------------------------------------------------------------------------- */
+static void setButton( pushbutton_t *button, bool pressed ) {
+    int chip = hwPinChip(button->btnPin);
+    int bit  = __builtin_ctz(hwPinMask(button->btnPin));
+    if ( pressed ) {
+        simPressButton(chip, bit);
+    } else {
+        simReleaseButton(chip, bit);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * pollButtons with nothing pressed, as on most of the 50 samples a second, and with
+ * zone buttons pressed and released all the time, switching valves. readButton and
+ * processRadioGroup on their own.
+ * ----------------------------------------------------------------------------------- */
+void benchButtons( void ) {
+    if ( !benchDaemon() ) {
+        return;
+    }
+    // zone buttons follow the control buttons
+    pushbutton_t *zones = pushButtons;
+    while ( zones->radioGroup != RG_VALVES ) {
+        zones++;
+    }
+    int numZones = (int)(&pushButtons[numButtons] - zones);
+
+    // idle: no edges
+    pollButtons(pushButtons, numButtons);
+    uint64_t allocs = benchAllocs();
+    uint64_t start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        pollButtons(pushButtons, numButtons);
+    }
+    uint64_t elapsed = benchClock() - start;
+    benchReport("buttons/pollButtons idle", ROUNDS, elapsed, benchAllocs() - allocs);
+
+    // busy: every zone button in turn pressed and released
+    allocs = benchAllocs();
+    start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        int cycle = round / EDGE_EVERY;
+        if ( round % EDGE_EVERY == 0 ) {
+            setButton(&zones[(cycle/2) % numZones], cycle % 2 == 0);
+        }
+        pollButtons(pushButtons, numButtons);
+    }
+    elapsed = benchClock() - start;
+    benchFlush();
+    benchReport("buttons/pollButtons edges", ROUNDS, elapsed, benchAllocs() - allocs);
+
+    // readButton alone, press and release of one zone button
+    pushbutton_t *button = &zones[0];
+    unsigned      up     = hwPinMask(button->btnPin);
+    allocs = benchAllocs();
+    start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        readButton(button, pushButtons, numButtons, (round & 1) ? up : 0);
+    }
+    elapsed = benchClock() - start;
+    benchFlush();
+    benchReport("buttons/readButton", ROUNDS, elapsed, benchAllocs() - allocs);
+
+    // processRadioGroup alone, switch on each zone in turn
+    allocs = benchAllocs();
+    start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        pushbutton_t *on = &zones[round % numZones];
+        on->state = true;
+        processRadioGroup(on, pushButtons, numButtons);
+    }
+    elapsed = benchClock() - start;
+    benchReport("buttons/processRadioGroup", ROUNDS, elapsed, benchAllocs() - allocs);
+    for ( int idx=0; idx<numZones; idx++ ) {
+        zones[idx].state = false;
+    }
+    benchFlush();
+}
@@ -0,0 +1,121 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "yardControl.h"
+#include "readConfig.h"
+#include "logging.h"
+
+#define TOTAL_LINES  1000000     // lines parsed per benchmark
+
+/* ----------------------------------------------------------------------------------- *
+ * Generated configs: size, and whether valves share a flow budget
+ * ----------------------------------------------------------------------------------- */
+typedef struct generated_t {
+    const char *name;
+    int         lines;
+    bool        flow;
+} generated_t;
+
+static const generated_t generated[] = {
+    { "config/readConfig 1k (per line)",         1000,   false },
+    { "config/readConfig 10k (per line)",        10000,  false },
+    { "config/readConfig 100k (per line)",       100000, false },
+    { "config/readConfig 100k flow (per line)",  100000, true  },
+};
+#define NUM_GENERATED (int)(sizeof(generated)/sizeof(generated[0]))
+
+/* ----------------------------------------------------------------------------------- *
+ * Write a config file the size of a large site: many sequences, each with its steps
+ * and start times, comments and blank lines in between. With flow the valves are
+ * packed into the flow budget. Returns number of lines.
+ * ----------------------------------------------------------------------------------- */
+static int writeConfig( FILE *fp, int maxLines, bool flow ) {
+    static const char *zones[] = { "A", "B", "C", "D" };
+    int lines = 0, seq = 0;
+
+    lines += fprintf(fp, "# generated for benchmark\n") > 0;
+    lines += fprintf(fp, "MQTTBROKER localhost\nMQTTPORT 1883\nCATCHUP 10\nRESUME STEP\n") > 0 ? 4 : 0;
+    for ( int idx=0; idx<4; idx++ ) {
+        lines += fprintf(fp, "ZONE %s %d %d\n", zones[idx], idx, idx+8) > 0;
+        if ( flow ) {
+            lines += fprintf(fp, "FLOW %s %d\n", zones[idx], 10 + 5*idx) > 0;
+        }
+    }
+    if ( flow ) {
+        lines += fprintf(fp, "FLOWBUDGET 30\nSOAK A 5\n") > 0 ? 2 : 0;
+    }
+    while ( lines < maxLines ) {
+        lines += fprintf(fp, "\n# ---- sequence %d\nSEQUENCE %d\n", seq, seq) > 0 ? 3 : 0;
+        for ( int step=0; step<40 && lines < maxLines; step++ ) {
+            if ( step % 10 == 9 ) {
+                lines += fprintf(fp, "  PAUSE %d\n", 1 + step/10) > 0;
+            } else {
+                lines += fprintf(fp, "  VALVE %s %d\n", zones[step%4], 5 + step%20) > 0;
+            }
+        }
+        lines += fprintf(fp, "TIME %d:%02d %d\nTIME 21:%02d %d MO,WE,FR\nTIME 5:30 %d EVERY 3\n",
+                         seq%24, seq%60, seq, seq%60, seq, seq) > 0 ? 3 : 0;
+        seq++;
+    }
+    return lines;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Parse one generated config until TOTAL_LINES lines are done, report time per line
+ * ----------------------------------------------------------------------------------- */
+static void benchGenerated( const generated_t *gen ) {
+    char  fileName[] = "/tmp/yardControl_benchXXXXXX";
+    int   fd = mkstemp(fileName);
+    FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if ( !fp ) {
+        printf("config: can't create %s\n", fileName);
+        return;
+    }
+    int lines = writeConfig(fp, gen->lines, gen->flow);
+    fclose(fp);
+
+    configFile = fileName;
+    int rounds = TOTAL_LINES / lines;
+
+    uint64_t allocs = benchAllocs();
+    uint64_t start  = benchClock();
+    for ( int round=0; round<rounds; round++ ) {
+        readConfig();
+    }
+    uint64_t elapsed = benchClock() - start;
+
+    printf("config: %d lines, %d zones, %d sequences, %zu bytes\n",
+           lines, config->numZones, config->numPrograms, config->size);
+    benchReport(gen->name, (unsigned long)lines*rounds, elapsed, benchAllocs() - allocs);
+    unlink(fileName);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Parse generated configs of different size
+ * ----------------------------------------------------------------------------------- */
+void benchConfig( void ) {
+    setLogLevel(LOG_WARNING);
+    for ( int idx=0; idx<NUM_GENERATED; idx++ ) {
+        benchGenerated(&generated[idx]);
+    }
+}
@@ -0,0 +1,150 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+
+#include "bench.h"
+#include "yardControl.h"
+#include "readConfig.h"
+#include "persistState.h"
+#include "mqttGateway.h"
+#include "publisher.h"
+#include "clockSource.h"
+#include "logging.h"
+
+#define BENCH_CHIP_ZONES  8      // zones on the second expander
+
+static char benchDir[] = "/tmp/yardControl_benchXXXXXX";   // state of the daemon
+
+/* ----------------------------------------------------------------------------------- *
+ * Entry points of yardControl.c, linked without main()
+ * ----------------------------------------------------------------------------------- */
+bool setupButtons(void);
+void setupIO(void);
+void activateSequence(int idx);
+mqttIncoming_t *commandSubscriptions(void);
+
+/* ----------------------------------------------------------------------------------- *
+ * Config of a larger site: the four default zones and eight more on a second
+ * expander, one sequence running all of them
+ * ----------------------------------------------------------------------------------- */
+static bool writeConfig( const char *fileName, const char *dir ) {
+    FILE *fp = fopen(fileName, "w");
+    if ( !fp ) {
+        return false;
+    }
+    fprintf(fp, "STATEDIR %s\nASYNCLOG 0\nMQTTBROKER localhost\n", dir);
+    fprintf(fp, "EXPANDER 1 0x20\nEXPANDER 1 0x21\n");
+    fprintf(fp, "ZONE A 0 8\nZONE B 1 9\nZONE C 2 10\nZONE D 3 11\n");
+    for ( int idx=0; idx<BENCH_CHIP_ZONES; idx++ ) {
+        fprintf(fp, "ZONE Z%d 1:A:%d 1:B:%d\n", idx, idx, idx);
+    }
+    fprintf(fp, "SEQUENCE 1\n  VALVE A 1\n  VALVE B 1\n  VALVE C 1\n  VALVE D 1\n");
+    for ( int idx=0; idx<BENCH_CHIP_ZONES; idx++ ) {
+        fprintf(fp, "  VALVE Z%d 1\n", idx);
+    }
+    fprintf(fp, "TIME 6:00 1\n");
+    return fclose(fp) == 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Remove state directory with the state and journal files written by the benchmarks.
+ * Not stateDir: benchConfig reads configs without STATEDIR.
+ * ----------------------------------------------------------------------------------- */
+static void removeStateDir( void ) {
+    char           path[PATH_MAX];
+    DIR           *dir = opendir(benchDir);
+    struct dirent *entry;
+
+    while ( dir && (entry = readdir(dir)) ) {
+        if ( entry->d_name[0] != '.' ) {
+            snprintf(path, sizeof(path), "%s/%s", benchDir, entry->d_name);
+            unlink(path);
+        }
+    }
+    if ( dir ) {
+        closedir(dir);
+    }
+    rmdir(benchDir);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Set up the daemon as main() does, with state in a temporary directory, the virtual
+ * clock, the simulated IO extender and MQTT connected to the stub in benchMosquitto.c
+ * ----------------------------------------------------------------------------------- */
+bool benchDaemon( void ) {
+    static int  done = 0;            // 1: set up, -1: failed
+    static char fileName[sizeof(benchDir) + 16];
+
+    if ( done ) {
+        return done > 0;
+    }
+    done = -1;
+    if ( !mkdtemp(benchDir) ) {
+        printf("daemon: can't create %s\n", benchDir);
+        return false;
+    }
+    atexit(&removeStateDir);
+    snprintf(fileName, sizeof(fileName), "%s/bench.cfg", benchDir);
+    if ( !writeConfig(fileName, benchDir) ) {
+        printf("daemon: can't write %s\n", fileName);
+        return false;
+    }
+    configFile = fileName;
+    readConfig();
+    unlink(fileName);
+    if ( !config || !setupButtons() ) {
+        return false;
+    }
+
+    clockSetVirtual(clockWall());
+    setupIO();
+    activateSequence(0);
+    publisherInit(pushButtons, numButtons, mqttBroker.prefix);
+    mqttIncoming_t *subscriptions = commandSubscriptions();
+    if ( !subscriptions || !mqttInit(mqttBroker.address, mqttBroker.port, mqttBroker.keepalive, subscriptions) ) {
+        printf("daemon: MQTT setup failed\n");
+        return false;
+    }
+    printf("daemon: %d buttons, state in %s\n", numButtons, benchDir);
+    done = 1;
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Wait for the network thread to hand all sent messages to the "broker"
+ * ----------------------------------------------------------------------------------- */
+void benchWaitPublished( unsigned long expected ) {
+    while ( atomic_load(&benchPublished) < expected ) {
+        sched_yield();
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Send button states queued by a benchmark, as the main loop does once per round.
+ * At most one message per button, that fits into the send queue.
+ * ----------------------------------------------------------------------------------- */
+void benchFlush( void ) {
+    unsigned long expected = atomic_load(&benchPublished);
+    benchWaitPublished(expected + publisherFlush());
+}
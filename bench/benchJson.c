@@ -0,0 +1,63 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "jsonCommand.h"
+
+#define ROUNDS 1000000
+
+/* ----------------------------------------------------------------------------------- *
+ * Payloads as they come from openHAB, Node-RED and hand written mosquitto_pub calls
+ * ----------------------------------------------------------------------------------- */
+static const char *payloads[] = {
+    "{\"state\":\"ON\"}",
+    "{\"state\":\"OFF\"}",
+    "{ \"State\" : \"on\", \"duration\" : 15 }",
+    "{\"id\":\"a8f3-22\",\"state\":1,\"duration\":\"30\"}",
+    "{\"source\":{\"app\":\"nodered\",\"flow\":[1,2,3]},\"state\":false}",
+    "OFF",
+};
+#define NUM_PAYLOADS (int)(sizeof(payloads)/sizeof(payloads[0]))
+
+/* ----------------------------------------------------------------------------------- *
+ * Parse a burst of commands, report time per command
+ * ----------------------------------------------------------------------------------- */
+void benchJson( void ) {
+    int      lengths[NUM_PAYLOADS];
+    unsigned accepted = 0;
+
+    for ( int idx=0; idx<NUM_PAYLOADS; idx++ ) {
+        lengths[idx] = (int)strlen(payloads[idx]);
+    }
+
+    uint64_t allocs = benchAllocs();
+    uint64_t start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        command_t command;
+        int       idx = round % NUM_PAYLOADS;
+        accepted += parseCommand(payloads[idx], lengths[idx], &command);
+    }
+    uint64_t elapsed = benchClock() - start;
+
+    if ( accepted != ROUNDS ) {
+        printf("json: %u of %d payloads rejected\n", ROUNDS-accepted, ROUNDS);
+    }
+    benchReport("json/parseCommand", ROUNDS, elapsed, benchAllocs() - allocs);
+}
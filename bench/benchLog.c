@@ -0,0 +1,71 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+
+#include "bench.h"
+#include "logging.h"
+
+#define ROUNDS 1000000
+
+/* ----------------------------------------------------------------------------------- *
+ * writeLog at a level that is switched off, and one that is written: formatted on
+ * the caller's thread to stdout (/dev/null here), or queued for the log thread
+ * ----------------------------------------------------------------------------------- */
+void benchLog( void ) {
+    static const char *names[] = { "A", "B", "Lawn", "Hedge" };
+    int level = getLogLevel();
+
+    benchQuiet(true);                            // no "Set log level" in the results
+    setLogLevel(LOG_NOTICE);
+    benchQuiet(false);
+    uint64_t allocs = benchAllocs();
+    uint64_t start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        writeLog(LOG_DEBUG, "Turn valve %s %s", names[round & 3], (round & 4) ? "ON" : "OFF");
+    }
+    uint64_t elapsed = benchClock() - start;
+    benchReport("log/writeLog disabled", ROUNDS, elapsed, benchAllocs() - allocs);
+
+    // message differs each time, "last message repeated" would hide the cost
+    benchQuiet(true);
+    allocs = benchAllocs();
+    start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        writeLog(LOG_NOTICE, "Turn valve %s %s %d", names[round & 3], (round & 4) ? "ON" : "OFF", round);
+    }
+    elapsed = benchClock() - start;
+    benchQuiet(false);
+    benchReport("log/writeLog enabled", ROUNDS, elapsed, benchAllocs() - allocs);
+
+    // queued records are dropped when the ring is full, that is part of the cost
+    benchQuiet(true);
+    startLogThread();
+    allocs = benchAllocs();
+    start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        writeLog(LOG_NOTICE, "Turn valve %s %s %d", names[round & 3], (round & 4) ? "ON" : "OFF", round);
+    }
+    elapsed = benchClock() - start;
+    stopLogThread();
+    benchQuiet(false);
+    benchReport("log/writeLog enabled, async", ROUNDS, elapsed, benchAllocs() - allocs);
+
+    benchQuiet(true);
+    setLogLevel(level);
+    benchQuiet(false);
+}
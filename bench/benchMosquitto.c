@@ -0,0 +1,110 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stddef.h>
+#include <stdbool.h>
+#include <mosquitto.h>
+
+#include "bench.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Stand-in for libmosquitto: a broker that is always connected and swallows every
+ * message. mqttGateway.c runs unchanged on top of it, network thread included.
+ * ----------------------------------------------------------------------------------- */
+struct mosquitto {
+    void (*onConnect)(struct mosquitto *, void *, int);
+};
+
+static struct mosquitto broker;
+atomic_ulong benchPublished = 0;
+
+int mosquitto_lib_init( void ) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_lib_cleanup( void ) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+struct mosquitto *mosquitto_new( const char *id, bool clean_session, void *obj ) {
+    return &broker;
+}
+
+void mosquitto_destroy( struct mosquitto *mosq ) {
+}
+
+int mosquitto_connect( struct mosquitto *mosq, const char *host, int port, int keepalive ) {
+    if ( mosq->onConnect ) {
+        mosq->onConnect(mosq, NULL, 0);
+    }
+    return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_reconnect( struct mosquitto *mosq ) {
+    return mosquitto_connect(mosq, NULL, 0, 0);
+}
+
+int mosquitto_publish( struct mosquitto *mosq, int *mid, const char *topic, int payloadlen,
+                       const void *payload, int qos, bool retain ) {
+    atomic_fetch_add(&benchPublished, 1);
+    return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_subscribe( struct mosquitto *mosq, int *mid, const char *sub, int qos ) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_loop_read( struct mosquitto *mosq, int max_packets ) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_loop_write( struct mosquitto *mosq, int max_packets ) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_loop_misc( struct mosquitto *mosq ) {
+    return MOSQ_ERR_SUCCESS;
+}
+
+bool mosquitto_want_write( struct mosquitto *mosq ) {
+    return false;
+}
+
+int mosquitto_socket( struct mosquitto *mosq ) {
+    return -1;                                   // nothing to poll, the wakeup fd is enough
+}
+
+const char *mosquitto_strerror( int mosq_errno ) {
+    return "stub";
+}
+
+void mosquitto_log_callback_set( struct mosquitto *mosq,
+                                 void (*on_log)(struct mosquitto *, void *, int, const char *) ) {
+}
+
+void mosquitto_message_callback_set( struct mosquitto *mosq,
+                                     void (*on_message)(struct mosquitto *, void *, const struct mosquitto_message *) ) {
+}
+
+void mosquitto_connect_callback_set( struct mosquitto *mosq,
+                                     void (*on_connect)(struct mosquitto *, void *, int) ) {
+    mosq->onConnect = on_connect;
+}
+
+void mosquitto_disconnect_callback_set( struct mosquitto *mosq,
+                                        void (*on_disconnect)(struct mosquitto *, void *, int) ) {
+}
@@ -0,0 +1,110 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "yardControl.h"
+#include "readConfig.h"
+#include "mqttGateway.h"
+#include "publisher.h"
+
+#define ROUNDS     1000000
+#define MAX_TOPICS 32
+
+void pressButtonCB(char *payload, int payloadlen, char *topic, void *buttonList);
+
+static char topics[MAX_TOPICS][MQTT_TOPIC_LEN];
+static int  numTopics = 0;
+static char payloadOn[]  = "{\"state\":\"ON\"}";
+static char payloadOff[] = "{\"state\":\"OFF\"}";
+
+/* ----------------------------------------------------------------------------------- *
+ * Command topic of each zone
+ * ----------------------------------------------------------------------------------- */
+static void buildTopics( void ) {
+    numTopics = 0;
+    for ( int btnIndex=0; btnIndex<numButtons && numTopics<MAX_TOPICS; btnIndex++ ) {
+        if ( pushButtons[btnIndex].radioGroup == RG_VALVES ) {
+            snprintf(topics[numTopics++], MQTT_TOPIC_LEN, "%s/Valve_%s",
+                     mqttBroker.command, pushButtons[btnIndex].name);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * ON/OFF commands for all zones: through the topic tree, straight to the handler,
+ * and the state messages sent back
+ * ----------------------------------------------------------------------------------- */
+void benchMqtt( void ) {
+    if ( !benchDaemon() ) {
+        return;
+    }
+    buildTopics();
+
+    // mqttDispatch: topic tree, command parser, valve switched
+    uint64_t allocs = benchAllocs();
+    uint64_t start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        char *payload = ((round / numTopics) & 1) ? payloadOff : payloadOn;
+        mqttDispatch(topics[round % numTopics], payload, (int)strlen(payload));
+    }
+    uint64_t elapsed = benchClock() - start;
+    benchReport("mqtt/mqttDispatch", ROUNDS, elapsed, benchAllocs() - allocs);
+    benchFlush();
+
+    // pressButtonCB without topic tree
+    allocs = benchAllocs();
+    start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        char *payload = ((round / numTopics) & 1) ? payloadOff : payloadOn;
+        pressButtonCB(payload, (int)strlen(payload), topics[round % numTopics], pushButtons);
+    }
+    elapsed = benchClock() - start;
+    benchReport("mqtt/pressButtonCB", ROUNDS, elapsed, benchAllocs() - allocs);
+    benchFlush();
+
+    // publishStatus: queue state of a button
+    allocs = benchAllocs();
+    start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        publishStatus(&pushButtons[round % numButtons]);
+    }
+    elapsed = benchClock() - start;
+    benchReport("mqtt/publishStatus", ROUNDS, elapsed, benchAllocs() - allocs);
+    benchFlush();
+
+    // publishStatus and publisherFlush of changed states, per message sent. The
+    // network thread catches up between rounds, that time is not counted.
+    unsigned long sent = 0;
+    elapsed = 0;
+    allocs  = benchAllocs();
+    for ( int round=0; round<2*(ROUNDS/numButtons/2); round++ ) {   // even: states as before
+        unsigned long expected = atomic_load(&benchPublished);
+        start = benchClock();
+        for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
+            pushButtons[btnIndex].state = !pushButtons[btnIndex].state;
+            publishStatus(&pushButtons[btnIndex]);
+        }
+        int flushed = publisherFlush();
+        elapsed += benchClock() - start;
+        sent    += flushed;
+        benchWaitPublished(expected + flushed);
+    }
+    benchReport("mqtt/publisherFlush (per message)", sent, elapsed, benchAllocs() - allocs);
+}
@@ -0,0 +1,82 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "yardControl.h"
+#include "scheduler.h"
+#include "clockSource.h"
+
+#define ROUNDS  1000000
+#define STEPS   20000
+
+/* ----------------------------------------------------------------------------------- *
+ * Entry points and state of yardControl.c
+ * ----------------------------------------------------------------------------------- */
+void startSequence(pushbutton_t *button);
+void processSequence(void);
+extern int sequenceInProgress;
+
+/* ----------------------------------------------------------------------------------- *
+ * Press the run button
+ * ----------------------------------------------------------------------------------- */
+static void runButton( bool on ) {
+    for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
+        if ( !strcmp(pushButtons[btnIndex].name, "R") ) {
+            pushButtons[btnIndex].state = on;
+            startSequence(&pushButtons[btnIndex]);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * processSequence with nothing due, and stepping through the sequence on the
+ * virtual clock: valves switched, journal written, sequence started again at the end
+ * ----------------------------------------------------------------------------------- */
+void benchSequence( void ) {
+    if ( !benchDaemon() ) {
+        return;
+    }
+
+    runButton(true);
+    uint64_t allocs = benchAllocs();
+    uint64_t start  = benchClock();
+    for ( int round=0; round<ROUNDS; round++ ) {
+        processSequence();
+    }
+    uint64_t elapsed = benchClock() - start;
+    benchReport("sequence/processSequence idle", ROUNDS, elapsed, benchAllocs() - allocs);
+
+    int restarts = 0;
+    allocs = benchAllocs();
+    start  = benchClock();
+    for ( int round=0; round<STEPS; round++ ) {
+        if ( !sequenceInProgress ) {
+            runButton(true);
+            restarts++;
+        }
+        clockAdvance(schedulerNextDeadline() - clockMono());
+        processSequence();
+    }
+    elapsed = benchClock() - start;
+    runButton(false);
+    benchFlush();
+    printf("sequence: %d steps, %d sequence starts\n", STEPS, restarts);
+    benchReport("sequence/processSequence step", STEPS, elapsed, benchAllocs() - allocs);
+}
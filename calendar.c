@@ -0,0 +1,122 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "calendar.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Names of week days as used in the config file, index is tm_wday
+ * ----------------------------------------------------------------------------------- */
+static const char *dayNames[] = { "SU", "MO", "TU", "WE", "TH", "FR", "SA" };
+
+/* ----------------------------------------------------------------------------------- *
+ * Number of days since 1970-01-01 for the date in tm, used for EVERY <n> days
+ * ----------------------------------------------------------------------------------- */
+static long dayNumber( const struct tm *tm ) {
+    struct tm date;
+    memset(&date, 0, sizeof(date));
+    date.tm_year = tm->tm_year;
+    date.tm_mon  = tm->tm_mon;
+    date.tm_mday = tm->tm_mday;
+    return (long)(timegm(&date) / 86400);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Find the first start time after the given point in time, 0 if there is none
+ *
+ * Candidates are built in local time and converted with mktime, so DST changes are
+ * handled by the C library: a start time that falls into the gap of the spring
+ * change runs an hour later, it is never dropped.
+ * ----------------------------------------------------------------------------------- */
+time_t calendarNextStart( const starttime_t *times, time_t after ) {
+    time_t    next = 0;
+    struct tm today;
+
+    localtime_r(&after, &today);
+
+    // every combination of week days and interval repeats after 7*MAX_INTERVAL days
+    for ( int day=0; day <= 7*MAX_INTERVAL && !next; day++ ) {
+        for ( int idx=0; times[idx].tm_hour >= 0; idx++ ) {
+            struct tm candidate = today;
+            candidate.tm_mday  += day;
+            candidate.tm_hour   = times[idx].tm_hour;
+            candidate.tm_min    = times[idx].tm_min;
+            candidate.tm_sec    = 0;
+            candidate.tm_isdst  = -1;
+
+            time_t when = mktime(&candidate);            // also sets tm_wday
+            if ( when <= after ) continue;
+            if ( !(times[idx].days & (1 << candidate.tm_wday)) ) continue;
+            if ( times[idx].interval > 1 && dayNumber(&candidate) % times[idx].interval ) continue;
+
+            if ( !next || when < next ) {
+                next = when;
+            }
+        }
+    }
+    return next;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Parse comma separated list of week days, returns bit mask or -1 on error
+ * ----------------------------------------------------------------------------------- */
+int calendarParseDays( const char *days, int len ) {
+    const char *end = days+len;
+    int mask = 0;
+    while ( days < end ) {
+        int wday;
+        if ( end-days < 2 ) {
+            return -1;
+        }
+        for ( wday=0; wday<7; wday++ ) {
+            if ( toupper(days[0]) == dayNames[wday][0] && toupper(days[1]) == dayNames[wday][1] ) {
+                break;
+            }
+        }
+        if ( wday == 7 ) {
+            return -1;
+        }
+        mask |= 1 << wday;
+        days += 2;
+        if ( days < end && *days == ',' ) {
+            days++;
+        } else if ( days < end ) {
+            return -1;
+        }
+    }
+    return mask ? mask : -1;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Format rule of a start time in config file syntax (empty for "every day")
+ * ----------------------------------------------------------------------------------- */
+void calendarFormatRule( const starttime_t *time, char *buffer, int size ) {
+    int len = 0;
+    buffer[0] = '\0';
+    if ( time->interval > 1 ) {
+        snprintf(buffer, size, " EVERY %d", time->interval);
+    } else if ( time->days != ALL_DAYS ) {
+        for ( int wday=0; wday<7 && len+4 < size; wday++ ) {
+            if ( time->days & (1 << wday) ) {
+                len += snprintf(buffer+len, size-len, "%c%s", len ? ',' : ' ', dayNames[wday]);
+            }
+        }
+    }
+}
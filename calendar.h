@@ -0,0 +1,37 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <time.h>
+#include "readConfig.h"
+
+#ifndef calendar_h
+#define calendar_h
+
+/* ----------------------------------------------------------------------------------- *
+ * Settings
+ * ----------------------------------------------------------------------------------- */
+#define ALL_DAYS          0x7f       // bit 0 = sunday ... bit 6 = saturday
+#define MAX_INTERVAL       365       // EVERY <n> days, max. value for n
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+time_t calendarNextStart(const starttime_t *times, time_t after);  // next start > after
+int    calendarParseDays(const char *days, int len);               // "MO,WE,FR" -> mask
+void   calendarFormatRule(const starttime_t *time, char *buffer, int size);
+
+#endif /* calendar_h */
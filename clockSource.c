@@ -0,0 +1,66 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdatomic.h>
+
+#include "clockSource.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Virtual clock, read by the log thread as well
+ * ----------------------------------------------------------------------------------- */
+static atomic_bool  virtualClock = false;
+static atomic_llong virtualStart = 0;        // wall time the virtual clock started at
+static atomic_llong virtualTime  = 0;        // seconds since virtualStart
+
+time_t clockWall( void ) {
+    if ( atomic_load_explicit(&virtualClock, memory_order_relaxed) ) {
+        return (time_t)atomic_load_explicit(&virtualStart, memory_order_relaxed) + (time_t)atomic_load_explicit(&virtualTime, memory_order_relaxed);
+    }
+    return time(NULL);
+}
+
+time_t clockMono( void ) {
+    struct timespec now;
+    if ( atomic_load_explicit(&virtualClock, memory_order_relaxed) ) {
+        return VIRTUAL_MONO_BASE + (time_t)atomic_load_explicit(&virtualTime, memory_order_relaxed);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Switch to virtual clock, call before any other thread is started
+ * ----------------------------------------------------------------------------------- */
+void clockSetVirtual( time_t start ) {
+    atomic_store(&virtualStart, (long long)start);
+    atomic_store(&virtualTime, 0);
+    atomic_store(&virtualClock, true);
+}
+
+void clockAdvance( time_t seconds ) {
+    if ( seconds > 0 ) {
+        atomic_fetch_add(&virtualTime, (long long)seconds);
+    }
+}
+
+void clockStep( time_t seconds ) {
+    atomic_fetch_add(&virtualStart, (long long)seconds);
+}
+
+bool clockIsVirtual( void ) {
+    return atomic_load_explicit(&virtualClock, memory_order_relaxed);
+}
@@ -0,0 +1,46 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+#include <time.h>
+
+#ifndef clockSource_h
+#define clockSource_h
+
+/* ----------------------------------------------------------------------------------- *
+ * All time is read through here:
+ *
+ *   clockWall()  wall clock, for start times, log and journal time stamps
+ *   clockMono()  seconds that never jump, for sequence steps and durations
+ *
+ * Both come from the system, unless the virtual clock has been switched on. Then
+ * time only moves with clockAdvance(), as fast as the caller likes. clockStep() makes
+ * the wall clock jump like it does when NTP sets the time.
+ * ----------------------------------------------------------------------------------- */
+#define VIRTUAL_MONO_BASE  1000000   // clockMono() of virtual clock at start, never 0
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+time_t clockWall(void);                 // seconds since the epoch
+time_t clockMono(void);                 // seconds of CLOCK_MONOTONIC
+void   clockSetVirtual(time_t start);   // switch to virtual clock, starting at wall time start
+void   clockAdvance(time_t seconds);    // move virtual clock forward
+void   clockStep(time_t seconds);       // set virtual wall clock, clockMono() stays
+bool   clockIsVirtual(void);
+
+#endif /* clockSource_h */
@@ -30,7 +30,6 @@
 /* ----------------------------------------------------------------------------------- *
  * Local prototype
  * ----------------------------------------------------------------------------------- */
-static void signalCB( int sigval );
 static void shutdown_daemon(void);
 static void writePid();
 
@@ -125,6 +124,8 @@ void signalCB(int sigval)
  * ----------------------------------------------------------------------------------- */
 void shutdown_daemon(void) {
     syslog(LOG_INFO, "Yard Control shutting down");
-    close(pidFilehandle);
-    unlink(pidFile);
+    if ( pidFile ) {                         // only when running as daemon
+        close(pidFilehandle);
+        unlink(pidFile);
+    }
 }
@@ -25,4 +25,11 @@
  * ----------------------------------------------------------------------------------- */
 void daemonize(const char *pidFile);
 
+/* ----------------------------------------------------------------------------------- *
+ * handle signals sent to the daemon
+ *
+ * INPUT: sigval -> signal number (SIGHUP, SIGTERM, SIGINT)
+ * ----------------------------------------------------------------------------------- */
+void signalCB(int sigval);
+
 #endif /* daemon_h */
@@ -0,0 +1,65 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <string.h>
+
+#include "debounce.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Initialize debouncer, thresholds are clamped to 1..15 samples
+ * ----------------------------------------------------------------------------------- */
+void debounceInit( debounce_t *db, int pressSamples, int releaseSamples ) {
+    int max = (1 << DEBOUNCE_BITS) - 1;
+    memset(db, 0, sizeof(debounce_t));
+    db->pressSamples   = pressSamples   < 1 ? 1 : pressSamples   > max ? max : pressSamples;
+    db->releaseSamples = releaseSamples < 1 ? 1 : releaseSamples > max ? max : releaseSamples;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Feed a new sample, returns mask of inputs whose debounced level changed
+ * ----------------------------------------------------------------------------------- */
+unsigned debounceUpdate( debounce_t *db, unsigned sample ) {
+    if ( !db->primed ) {                      // first sample is taken as is
+        db->state  = sample;
+        db->primed = true;
+        return 0;
+    }
+
+    // count samples that differ from the debounced state, reset the others
+    unsigned delta = sample ^ db->state;
+    unsigned carry = delta;
+    for ( int bit=0; bit<DEBOUNCE_BITS; bit++ ) {
+        unsigned old = db->count[bit];
+        db->count[bit] = (old ^ carry) & delta;
+        carry &= old;
+    }
+
+    // compare all counters against the threshold matching their current level
+    unsigned atPress = ~0u, atRelease = ~0u;
+    for ( int bit=0; bit<DEBOUNCE_BITS; bit++ ) {
+        atPress   &= (db->pressSamples   >> bit) & 1 ? db->count[bit] : ~db->count[bit];
+        atRelease &= (db->releaseSamples >> bit) & 1 ? db->count[bit] : ~db->count[bit];
+    }
+    unsigned changed = delta & ((db->state & atPress) | (~db->state & atRelease));
+
+    // accept new levels and restart their counters
+    db->state ^= changed;
+    for ( int bit=0; bit<DEBOUNCE_BITS; bit++ ) {
+        db->count[bit] &= ~changed;
+    }
+    return changed;
+}
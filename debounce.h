@@ -0,0 +1,47 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+
+#ifndef debounce_h
+#define debounce_h
+
+/* ----------------------------------------------------------------------------------- *
+ * Settings
+ * ----------------------------------------------------------------------------------- */
+#define DEBOUNCE_BITS       4    // counter width, allows for up to 15 stable samples
+
+/* ----------------------------------------------------------------------------------- *
+ * Debouncer for all inputs of a sample word. Each input has its own counter, but the
+ * counters are stored bit sliced ("vertical"): count[n] holds bit n of all of them,
+ * so one update handles every input with a handful of bitwise operations.
+ * ----------------------------------------------------------------------------------- */
+typedef struct debounce_t {
+    unsigned state;                     // debounced levels
+    unsigned count[DEBOUNCE_BITS];      // vertical counters of samples differing from state
+    int      pressSamples;              // stable LOW samples needed to accept a press
+    int      releaseSamples;            // stable HIGH samples needed to accept a release
+    bool     primed;                    // state has been set from a first sample
+} debounce_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+void     debounceInit  (debounce_t *db, int pressSamples, int releaseSamples);
+unsigned debounceUpdate(debounce_t *db, unsigned sample);  // returns changed inputs
+
+#endif /* debounce_h */
@@ -0,0 +1,187 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+
+#include "eventLoop.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * File descriptors we are waiting on
+ * ----------------------------------------------------------------------------------- */
+static int epollFd    = -1;                   // epoll set
+static int sampleFd   = -1;                   // periodic timer for input sampling
+static int deadlineFd = -1;                   // one shot timer for next deadline, wall clock
+static int stepFd     = -1;                   // one shot timer for next sequence step, monotonic
+static int signalFd   = -1;                   // delivers SIGHUP, SIGTERM and SIGINT
+static int wakeupFd   = -1;                   // poked by other threads
+
+static time_t armedDeadline = 0;              // deadline the timer is currently set to
+static time_t armedStep     = 0;              // same for the step timer
+
+/* ----------------------------------------------------------------------------------- *
+ * Add file descriptor to epoll set, the event mask is used as tag
+ * ----------------------------------------------------------------------------------- */
+static bool watchFd( int fd, int tag ) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN;
+    ev.data.u32 = tag;
+    if ( fd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0 ) {
+        writeLog(LOG_ERR, "Error: can't watch event source %d [%s]", tag, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Set up event loop
+ *
+ * Signals are blocked here and delivered through the signalfd instead, so this has to
+ * be called before any other thread is started.
+ * ----------------------------------------------------------------------------------- */
+bool eventLoopInit( int samplePeriodMs ) {
+    bool success = true;
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    epollFd    = epoll_create1(EPOLL_CLOEXEC);
+    sampleFd   = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    deadlineFd = timerfd_create(CLOCK_REALTIME,  TFD_NONBLOCK|TFD_CLOEXEC);
+    stepFd     = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    signalFd   = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+    wakeupFd   = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+
+    if ( epollFd < 0 ) {
+        writeLog(LOG_ERR, "Error: epoll_create1 [%s]", strerror(errno));
+        return false;
+    }
+
+    success &= watchFd(sampleFd,   EV_SAMPLE);
+    success &= watchFd(deadlineFd, EV_DEADLINE);
+    success &= watchFd(stepFd,     EV_STEP);
+    success &= watchFd(signalFd,   EV_SIGNAL);
+    success &= watchFd(wakeupFd,   EV_WAKEUP);
+
+    if ( success ) {
+        struct itimerspec period;
+        period.it_interval.tv_sec  = samplePeriodMs / 1000;
+        period.it_interval.tv_nsec = (samplePeriodMs % 1000) * 1000000L;
+        period.it_value            = period.it_interval;
+        timerfd_settime(sampleFd, 0, &period, NULL);
+    }
+    return success;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Arm deadline timer, nothing to do if it's already set to the requested time
+ *
+ * The timer is canceled when the wall clock is set, so we get a chance to recalculate
+ * deadlines after NTP or the user stepped the clock.
+ * ----------------------------------------------------------------------------------- */
+void eventLoopSetDeadline( time_t deadline ) {
+    if ( deadline != armedDeadline ) {
+        struct itimerspec when;
+        memset(&when, 0, sizeof(when));
+        when.it_value.tv_sec = deadline;
+        if ( timerfd_settime(deadlineFd, TFD_TIMER_ABSTIME|TFD_TIMER_CANCEL_ON_SET, &when, NULL) < 0 ) {
+            writeLog(LOG_ERR, "Error: can't arm deadline timer [%s]", strerror(errno));
+        }
+        armedDeadline = deadline;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Arm step timer, deadline is in seconds of CLOCK_MONOTONIC (clockMono()), 0 disarms
+ * it. Setting the wall clock doesn't move sequence steps.
+ * ----------------------------------------------------------------------------------- */
+void eventLoopSetStep( time_t deadline ) {
+    if ( deadline != armedStep ) {
+        struct itimerspec when;
+        memset(&when, 0, sizeof(when));
+        when.it_value.tv_sec = deadline;
+        if ( timerfd_settime(stepFd, TFD_TIMER_ABSTIME, &when, NULL) < 0 ) {
+            writeLog(LOG_ERR, "Error: can't arm step timer [%s]", strerror(errno));
+        }
+        armedStep = deadline;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Wake up event loop
+ * ----------------------------------------------------------------------------------- */
+void eventLoopWakeup( void ) {
+    uint64_t one = 1;
+    if ( wakeupFd >= 0 ) {
+        write(wakeupFd, &one, sizeof(one));
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Sleep until one of the event sources fires, return mask of events that did
+ * ----------------------------------------------------------------------------------- */
+int eventLoopWait( int *signal ) {
+    struct epoll_event ev[5];
+    int events = 0;
+
+    int count = epoll_wait(epollFd, ev, 5, -1);
+    for ( int idx=0; idx<count; idx++ ) {
+        uint64_t expirations;
+        struct signalfd_siginfo info;
+
+        switch ( ev[idx].data.u32 ) {
+            case EV_SAMPLE:
+                read(sampleFd, &expirations, sizeof(expirations));
+                break;
+            case EV_DEADLINE:
+                // ECANCELED: clock has been set, treat like a deadline to re-evaluate
+                if ( read(deadlineFd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED ) {
+                    writeLog(LOG_NOTICE, "System clock has been set");
+                }
+                armedDeadline = 0;
+                break;
+            case EV_STEP:
+                read(stepFd, &expirations, sizeof(expirations));
+                armedStep = 0;
+                break;
+            case EV_WAKEUP:
+                read(wakeupFd, &expirations, sizeof(expirations));
+                break;
+            case EV_SIGNAL:
+                if ( read(signalFd, &info, sizeof(info)) == sizeof(info) && signal ) {
+                    *signal = info.ssi_signo;
+                }
+                break;
+        }
+        events |= ev[idx].data.u32;
+    }
+    return events;
+}
@@ -0,0 +1,47 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+#include <time.h>
+
+#ifndef eventLoop_h
+#define eventLoop_h
+
+/* ----------------------------------------------------------------------------------- *
+ * Settings
+ * ----------------------------------------------------------------------------------- */
+#define SAMPLE_PERIOD_MS   20    // sample push buttons every 20ms
+
+/* ----------------------------------------------------------------------------------- *
+ * Events returned by eventLoopWait (may be or'ed together)
+ * ----------------------------------------------------------------------------------- */
+#define EV_SAMPLE    0x01        // time to sample inputs
+#define EV_DEADLINE  0x02        // wall clock deadline reached (start times)
+#define EV_WAKEUP    0x04        // woken up by another thread
+#define EV_SIGNAL    0x08        // signal received
+#define EV_STEP      0x10        // sequence step or valve timer due (monotonic)
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+bool eventLoopInit(int samplePeriodMs);      // create epoll set, timers, signal- and eventfd
+void eventLoopSetDeadline(time_t deadline);  // (re)arm deadline timer, absolute wall time
+void eventLoopSetStep(time_t deadline);      // (re)arm step timer, clockMono() time, 0: off
+void eventLoopWakeup(void);                  // wake up event loop, safe from any thread
+int  eventLoopWait(int *signal);             // sleep until something happens
+
+#endif /* eventLoop_h */
@@ -0,0 +1,412 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <pthread.h>
+
+#include "hardware.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Some globals we can't do without
+ * ----------------------------------------------------------------------------------- */
+atomic_ulong hwTransactions = 0;              // I2C transactions issued so far
+
+/* ----------------------------------------------------------------------------------- *
+ * State of an IO extender
+ * ----------------------------------------------------------------------------------- */
+typedef struct hwChip_t {
+    int      handle;                          // handle returned by backend
+    int      address;                         // I2C address
+    int      iodir[2];                        // cached direction registers (A/B)
+    int      gppu[2];                         // cached pull up registers (A/B)
+    int      olat[2];                         // shadow of output latches (A/B)
+    int      dirty;                           // ports with unwritten changes (bit 0: A)
+    int      inputs;                          // ports with input pins (bit 0: A)
+    unsigned sample;                          // inputs read by last hwSample
+} hwChip_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * An I2C bus and the chips on it. Transactions on different buses don't wait for
+ * each other, so each bus is serviced by a thread of its own; the first one, and any
+ * bus whose thread couldn't be started, by the main thread.
+ * ----------------------------------------------------------------------------------- */
+typedef struct hwBus_t {
+    int       bus;                            // N of /dev/i2c-N
+    hwChip_t *chip[HW_CHIPS_PER_BUS];
+    int       numChips;
+    bool      threaded;                       // serviced by a thread of its own
+    pthread_t thread;
+} hwBus_t;
+
+#define TASK_SAMPLE  1
+#define TASK_FLUSH   2
+
+/* ----------------------------------------------------------------------------------- *
+ * local data
+ * ----------------------------------------------------------------------------------- */
+static const hwBackend_t *hw = NULL;          // backend in use
+static int      base     = 0;                 // first pin number of first IO extender
+static hwChip_t chips[HW_MAX_CHIPS];
+static int      numChips = 0;
+static hwBus_t  buses[HW_MAX_BUSES];
+static int      numBuses = 0;
+static int      numThreads = 0;               // buses with a thread of their own
+
+static pthread_mutex_t busLock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  busStart   = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  busDone    = PTHREAD_COND_INITIALIZER;
+static unsigned        busRound   = 0;        // incremented for each task handed out
+static int             busTask    = 0;        // TASK_SAMPLE or TASK_FLUSH
+static int             busPending = 0;        // bus threads still working on task
+
+/* ----------------------------------------------------------------------------------- *
+ * Register access, counting transactions
+ * ----------------------------------------------------------------------------------- */
+static int readReg( hwChip_t *chip, int reg ) {
+    if ( chip->handle < 0 ) {                 // IO extender not available
+        return 0;
+    }
+    hwTransactions++;
+    return (hw->readReg)(chip->handle, reg);
+}
+
+static int readReg16( hwChip_t *chip, int reg ) {
+    if ( chip->handle < 0 ) {
+        return 0;
+    }
+    hwTransactions++;
+    return (hw->readReg16)(chip->handle, reg);
+}
+
+static void writeReg( hwChip_t *chip, int reg, int value ) {
+    if ( chip->handle >= 0 ) {
+        hwTransactions++;
+        (hw->writeReg)(chip->handle, reg, value);
+    }
+}
+
+static void writeReg16( hwChip_t *chip, int reg, int value ) {
+    if ( chip->handle >= 0 ) {
+        hwTransactions++;
+        (hw->writeReg16)(chip->handle, reg, value);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Chip, port and bit mask of a pin, pins are checked against the expanders when the
+ * config is read
+ * ----------------------------------------------------------------------------------- */
+static hwChip_t *pinChip( int pin ) {
+    int idx = (pin-base) / HW_CHIP_PINS;
+    return (idx >= 0 && idx < numChips) ? &chips[idx] : &chips[0];
+}
+
+#define PIN_PORT(pin) ((((pin)-base) >> 3) & 1)
+#define PIN_MASK(pin) (1 << (((pin)-base) & 7))
+
+/* ----------------------------------------------------------------------------------- *
+ * Read all ports with inputs in one transaction, bit 0..7 of the sample is port A,
+ * bit 8..15 port B. Ports without inputs read as 0.
+ * ----------------------------------------------------------------------------------- */
+static void sampleChip( hwChip_t *chip ) {
+    if ( chip->handle < 0 ) {
+        return;                               // missing chip, inputs stay released
+    }
+    switch ( chip->inputs ) {
+        case 1:
+            chip->sample = readReg(chip, MCP_GPIOA) & 0xff;
+            break;
+        case 2:
+            chip->sample = (readReg(chip, MCP_GPIOB) & 0xff) << 8;
+            break;
+        case 3:
+            chip->sample = readReg16(chip, MCP_GPIOA) & 0xffff;
+            break;
+        default:
+            chip->sample = 0;
+            break;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Write changed output latches to the chip, one transaction covers both ports
+ * ----------------------------------------------------------------------------------- */
+static void flushChip( hwChip_t *chip ) {
+    switch ( chip->dirty ) {
+        case 1:
+            writeReg(chip, MCP_OLATA, chip->olat[0]);
+            break;
+        case 2:
+            writeReg(chip, MCP_OLATB, chip->olat[1]);
+            break;
+        case 3:
+            writeReg16(chip, MCP_OLATA, chip->olat[0] | (chip->olat[1] << 8));
+            break;
+    }
+    chip->dirty = 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Do task for all chips of a bus
+ * ----------------------------------------------------------------------------------- */
+static void serviceBus( hwBus_t *bus, int task ) {
+    for ( int idx=0; idx<bus->numChips; idx++ ) {
+        if ( task == TASK_SAMPLE ) {
+            sampleChip(bus->chip[idx]);
+        } else {
+            flushChip(bus->chip[idx]);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Bus thread: wait for a task, do it, report back
+ * ----------------------------------------------------------------------------------- */
+static void *busThread( void *arg ) {
+    hwBus_t *bus  = arg;
+    unsigned done = 0;
+
+    pthread_mutex_lock(&busLock);
+    for ( ;; ) {
+        while ( busRound == done ) {
+            pthread_cond_wait(&busStart, &busLock);
+        }
+        done = busRound;
+        int task = busTask;
+        pthread_mutex_unlock(&busLock);
+
+        serviceBus(bus, task);
+
+        pthread_mutex_lock(&busLock);
+        if ( --busPending == 0 ) {
+            pthread_cond_signal(&busDone);
+        }
+    }
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Do task on all buses at the same time, returns when all of them are done
+ * ----------------------------------------------------------------------------------- */
+static void serviceBuses( int task ) {
+    if ( numBuses == 0 ) {
+        return;
+    }
+    if ( numThreads > 0 ) {
+        pthread_mutex_lock(&busLock);
+        busTask    = task;
+        busPending = numThreads;
+        busRound++;
+        pthread_cond_broadcast(&busStart);
+        pthread_mutex_unlock(&busLock);
+    }
+
+    for ( int idx=0; idx<numBuses; idx++ ) {
+        if ( !buses[idx].threaded ) {         // first bus and those without thread are ours
+            serviceBus(&buses[idx], task);
+        }
+    }
+
+    if ( numThreads > 0 ) {
+        pthread_mutex_lock(&busLock);
+        while ( busPending > 0 ) {
+            pthread_cond_wait(&busDone, &busLock);
+        }
+        pthread_mutex_unlock(&busLock);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Find bus, add it if it's new
+ * ----------------------------------------------------------------------------------- */
+static hwBus_t *findBus( int number ) {
+    for ( int idx=0; idx<numBuses; idx++ ) {
+        if ( buses[idx].bus == number ) {
+            return &buses[idx];
+        }
+    }
+    if ( numBuses == HW_MAX_BUSES ) {
+        return NULL;
+    }
+    buses[numBuses].bus      = number;
+    buses[numBuses].numChips = 0;
+    buses[numBuses].threaded = false;
+    return &buses[numBuses++];
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Open IO extenders with given backend and read their current settings. Chips that
+ * can't be opened are left out, their inputs read as HIGH and writes are dropped.
+ * ----------------------------------------------------------------------------------- */
+bool hwSetup( const hwBackend_t *backend, int pinBase, const expander_t *expanders, int count ) {
+    bool success = true;
+
+    hw       = backend;
+    base     = pinBase;
+    numChips = 0;
+    numBuses = 0;
+    numThreads = 0;
+    for ( int idx=0; idx<count && idx<HW_MAX_CHIPS; idx++ ) {
+        hwChip_t *chip = &chips[numChips++];
+        hwBus_t  *bus  = findBus(expanders[idx].bus);
+
+        chip->address = expanders[idx].address;
+        chip->handle  = -1;
+        chip->dirty   = 0;
+        chip->inputs  = 0;
+        chip->sample  = 0xffff;
+        if ( !bus || bus->numChips == HW_CHIPS_PER_BUS ) {
+            writeLog(LOG_ERR, "Error: too many IO extenders, ignoring i2c-%d 0x%02x",
+                     expanders[idx].bus, chip->address);
+            success = false;
+            continue;
+        }
+        bus->chip[bus->numChips++] = chip;
+
+        chip->handle = (hw->open)(expanders[idx].bus, chip->address);
+        if ( chip->handle < 0 ) {
+            writeLog(LOG_ERR, "Error: can't open IO extender at i2c-%d 0x%02x (%s)",
+                     expanders[idx].bus, chip->address, hw->name);
+            success = false;
+            continue;
+        }
+        writeReg(chip, MCP_IOCON, 0);         // BANK=0, sequential addressing
+        for ( int port=0; port<2; port++ ) {
+            chip->iodir[port] = readReg(chip, MCP_IODIRA+port);
+            chip->gppu[port]  = readReg(chip, MCP_GPPUA+port);
+            chip->olat[port]  = readReg(chip, MCP_OLATA+port);
+        }
+        writeLog(LOG_INFO, "IO extender at i2c-%d 0x%02x opened (%s)",
+                 expanders[idx].bus, chip->address, hw->name);
+    }
+
+    // every bus but the first gets a thread, if that fails the main thread takes over
+    for ( int idx=1; idx<numBuses; idx++ ) {
+        if ( pthread_create(&buses[idx].thread, NULL, &busThread, &buses[idx]) ) {
+            writeLog(LOG_ERR, "Error: can't start thread for i2c-%d, serviced by main thread",
+                     buses[idx].bus);
+            continue;
+        }
+        buses[idx].threaded = true;
+        numThreads++;
+    }
+    return success;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Set pin mode
+ * ----------------------------------------------------------------------------------- */
+void hwPinMode( int pin, int mode ) {
+    hwChip_t *chip = pinChip(pin);
+    int port = PIN_PORT(pin);
+    int mask = PIN_MASK(pin);
+    int old  = chip->iodir[port];
+
+    if ( mode == OUTPUT ) {
+        chip->iodir[port] &= ~mask;
+    } else {
+        chip->iodir[port] |= mask;
+        chip->inputs |= 1 << port;
+    }
+    if ( chip->iodir[port] != old ) {
+        writeReg(chip, MCP_IODIRA+port, chip->iodir[port]);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Enable/disable pull up resistor (the MCP23017 has no pull down)
+ * ----------------------------------------------------------------------------------- */
+void hwPullUpDn( int pin, int pud ) {
+    hwChip_t *chip = pinChip(pin);
+    int port = PIN_PORT(pin);
+    int mask = PIN_MASK(pin);
+    int old  = chip->gppu[port];
+
+    if ( pud == PUD_UP ) {
+        chip->gppu[port] |= mask;
+    } else {
+        chip->gppu[port] &= ~mask;
+    }
+    if ( chip->gppu[port] != old ) {
+        writeReg(chip, MCP_GPPUA+port, chip->gppu[port]);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Read input pin
+ * ----------------------------------------------------------------------------------- */
+int hwDigitalRead( int pin ) {
+    return (readReg(pinChip(pin), MCP_GPIOA+PIN_PORT(pin)) & PIN_MASK(pin)) ? HIGH : LOW;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Read inputs of all chips, one transaction per chip with inputs
+ * ----------------------------------------------------------------------------------- */
+void hwSample( void ) {
+    serviceBuses(TASK_SAMPLE);
+}
+
+unsigned hwChipSample( int chip ) {
+    return chips[chip].sample;
+}
+
+int hwNumChips( void ) {
+    return numChips;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Chip of a pin and the bit representing it in the sample of that chip
+ * ----------------------------------------------------------------------------------- */
+int hwPinChip( int pin ) {
+    return (int)(pinChip(pin) - chips);
+}
+
+unsigned hwPinMask( int pin ) {
+    return 1u << ((pin-base) & 15);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Set output pin, only the shadow register is changed here, see hwFlush
+ * ----------------------------------------------------------------------------------- */
+void hwDigitalWrite( int pin, int value ) {
+    hwChip_t *chip = pinChip(pin);
+    int port = PIN_PORT(pin);
+    int mask = PIN_MASK(pin);
+    int old  = chip->olat[port];
+
+    if ( value == LOW ) {
+        chip->olat[port] &= ~mask;
+    } else {
+        chip->olat[port] |= mask;
+    }
+    if ( chip->olat[port] != old ) {
+        chip->dirty |= 1 << port;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Write changed output latches of all chips, at most one transaction per chip
+ * ----------------------------------------------------------------------------------- */
+void hwFlush( void ) {
+    for ( int idx=0; idx<numChips; idx++ ) {
+        if ( chips[idx].dirty ) {
+            serviceBuses(TASK_FLUSH);
+            break;
+        }
+    }
+}
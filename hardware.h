@@ -0,0 +1,111 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifndef hardware_h
+#define hardware_h
+
+/* ----------------------------------------------------------------------------------- *
+ * Pin levels, modes and pull up settings (same values as used by wiringPi)
+ * ----------------------------------------------------------------------------------- */
+#ifndef LOW
+#define LOW            0
+#define HIGH           1
+#define INPUT          0
+#define OUTPUT         1
+#define PUD_OFF        0
+#define PUD_DOWN       1
+#define PUD_UP         2
+#endif
+
+/* ----------------------------------------------------------------------------------- *
+ * MCP23017 registers (IOCON.BANK = 0)
+ * ----------------------------------------------------------------------------------- */
+#define MCP_IODIRA     0x00
+#define MCP_IODIRB     0x01
+#define MCP_IOCON      0x0A
+#define MCP_GPPUA      0x0C
+#define MCP_GPPUB      0x0D
+#define MCP_GPIOA      0x12
+#define MCP_GPIOB      0x13
+#define MCP_OLATA      0x14
+#define MCP_OLATB      0x15
+#define MCP_NUM_REGS   0x16
+
+#define IOCON_SEQOP    0x20      // set: address pointer does not increment
+
+/* ----------------------------------------------------------------------------------- *
+ * Limits. Each chip has 16 pins, chip n uses pins pinBase+16*n .. pinBase+16*n+15
+ * ----------------------------------------------------------------------------------- */
+#define HW_CHIPS_PER_BUS  8      // MCP23017 address 0x20..0x27
+#define HW_MAX_BUSES      4      // /dev/i2c-N buses in use
+#define HW_MAX_CHIPS     (HW_CHIPS_PER_BUS*HW_MAX_BUSES)
+#define HW_CHIP_PINS     16
+
+/* ----------------------------------------------------------------------------------- *
+ * An IO extender: bus number N of /dev/i2c-N and I2C address
+ * ----------------------------------------------------------------------------------- */
+typedef struct expander_t {
+    int bus;
+    int address;
+} expander_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * A hardware backend gives register level access to an MCP23017 IO extender.
+ * Each call is one I2C transaction. The 16 bit variants access reg (low byte) and
+ * reg+1 (high byte) using sequential addressing.
+ * ----------------------------------------------------------------------------------- */
+typedef struct hwBackend_t {
+    const char *name;                                    // backend name
+    int  (*open)      (int bus, int address);            // returns handle or -1 on error
+    int  (*readReg)   (int handle, int reg);             // read 8 bit register
+    int  (*writeReg)  (int handle, int reg, int value);  // write 8 bit register
+    int  (*readReg16) (int handle, int reg);             // read register pair
+    int  (*writeReg16)(int handle, int reg, int value);  // write register pair
+} hwBackend_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Available backends
+ * ----------------------------------------------------------------------------------- */
+#ifdef HAVE_WIRINGPI
+extern const hwBackend_t hwWiringPi;                   // real hardware via wiringPi
+#endif
+extern const hwBackend_t hwSimulator;                  // simulated MCP23017
+
+/* ----------------------------------------------------------------------------------- *
+ * Some globals we can't do without
+ * ----------------------------------------------------------------------------------- */
+extern atomic_ulong hwTransactions;                    // I2C transactions issued so far
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+bool hwSetup       ( const hwBackend_t *backend, int pinBase, const expander_t *chips, int numChips );
+void hwPinMode     ( int pin, int mode );              // INPUT or OUTPUT
+void hwPullUpDn    ( int pin, int pud );               // PUD_OFF or PUD_UP
+int  hwDigitalRead ( int pin );                        // read input pin
+void hwSample      ( void );                           // read input ports of all chips
+unsigned hwChipSample( int chip );                     // inputs of chip read by hwSample
+int  hwNumChips    ( void );                           // chips set up
+int  hwPinChip     ( int pin );                        // chip a pin belongs to
+unsigned hwPinMask ( int pin );                        // bit of pin in sample of its chip
+void hwDigitalWrite( int pin, int value );             // set output pin (buffered)
+void hwFlush       ( void );                           // write changed outputs to chips
+
+#endif /* hardware_h */
@@ -0,0 +1,180 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <string.h>
+
+#include "hwSimulator.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * State of a simulated chip
+ * ----------------------------------------------------------------------------------- */
+typedef struct simChip_t {
+    bool          present;                    // chip has been opened
+    unsigned char reg[MCP_NUM_REGS];          // register file
+    unsigned int  driven;                     // input pins driven from outside (bit mask)
+    unsigned int  level;                      // level of driven pins
+} simChip_t;
+
+static simChip_t chip[SIM_MAX_CHIPS];
+static int       simBus[SIM_MAX_BUSES];       // bus numbers in order of first use
+static int       simBuses = 0;
+
+atomic_ulong simReads  = 0;                   // register reads
+atomic_ulong simWrites = 0;                   // register writes
+
+/* ----------------------------------------------------------------------------------- *
+ * Pin levels as seen on GPIOA/GPIOB: inputs show the level applied from outside or
+ * the pull up, outputs show the output latch
+ * ----------------------------------------------------------------------------------- */
+static int portLevel( simChip_t *c, int port ) {
+    int inputs = c->reg[MCP_IODIRA+port];
+    int driven = (c->driven >> (8*port)) & 0xff;
+    int level  = (c->level  >> (8*port)) & 0xff;
+    int pullUp = c->reg[MCP_GPPUA+port];
+
+    int in  = (driven & level) | (~driven & pullUp);
+    return ((inputs & in) | (~inputs & c->reg[MCP_OLATA+port])) & 0xff;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Backend: open chip, registers get their power on reset values
+ * ----------------------------------------------------------------------------------- */
+static int simOpen( int bus, int address ) {
+    int slot;
+    if ( address < 0x20 || address > 0x27 ) {
+        return -1;
+    }
+    for ( slot=0; slot<simBuses && simBus[slot] != bus; slot++ );
+    if ( slot == simBuses ) {
+        if ( simBuses == SIM_MAX_BUSES ) {
+            return -1;
+        }
+        simBus[simBuses++] = bus;
+    }
+    int handle = 8*slot + (address & 7);
+    simChip_t *c = &chip[handle];
+    memset(c, 0, sizeof(simChip_t));
+    c->reg[MCP_IODIRA] = 0xff;
+    c->reg[MCP_IODIRB] = 0xff;
+    c->present = true;
+    return handle;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Backend: read register
+ * ----------------------------------------------------------------------------------- */
+static int simReadReg( int handle, int reg ) {
+    simChip_t *c = &chip[handle];
+    simReads++;
+    if ( reg == MCP_GPIOA || reg == MCP_GPIOB ) {
+        return portLevel(c, reg-MCP_GPIOA);
+    }
+    return reg < MCP_NUM_REGS ? c->reg[reg] : 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Backend: write register, writing GPIO ends up in the output latch
+ * ----------------------------------------------------------------------------------- */
+static int simWriteReg( int handle, int reg, int value ) {
+    simChip_t *c = &chip[handle];
+    simWrites++;
+    if ( reg == MCP_GPIOA || reg == MCP_GPIOB ) {
+        reg += MCP_OLATA-MCP_GPIOA;
+    }
+    if ( reg < MCP_NUM_REGS ) {
+        c->reg[reg] = value & 0xff;
+    }
+    return 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Backend: read register pair in one transaction
+ * ----------------------------------------------------------------------------------- */
+static int simReadReg16( int handle, int reg ) {
+    simChip_t *c = &chip[handle];
+    int next = (c->reg[MCP_IOCON] & IOCON_SEQOP) ? reg : reg+1;
+    int value = simReadReg(handle, reg) | (simReadReg(handle, next) << 8);
+
+    simReads--;                               // both bytes came in one transaction
+    return value;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Backend: write register pair in one transaction. Like on the real chip the address
+ * pointer only advances if sequential operation is enabled.
+ * ----------------------------------------------------------------------------------- */
+static int simWriteReg16( int handle, int reg, int value ) {
+    simChip_t *c = &chip[handle];
+    int next = (c->reg[MCP_IOCON] & IOCON_SEQOP) ? reg : reg+1;
+
+    simWriteReg(handle, reg,  value & 0xff);
+    simWriteReg(handle, next, (value >> 8) & 0xff);
+    simWrites--;                              // both bytes went in one transaction
+    return 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Backend definition
+ * ----------------------------------------------------------------------------------- */
+const hwBackend_t hwSimulator = {
+    "simulator",
+    &simOpen,
+    &simReadReg,
+    &simWriteReg,
+    &simReadReg16,
+    &simWriteReg16,
+};
+
+/* ----------------------------------------------------------------------------------- *
+ * Drive pins from outside
+ * ----------------------------------------------------------------------------------- */
+void simSetInput( int handle, int bit, int level ) {
+    chip[handle].driven |= 1 << bit;
+    if ( level ) {
+        chip[handle].level |=  (1 << bit);
+    } else {
+        chip[handle].level &= ~(1 << bit);
+    }
+}
+
+void simReleaseInput( int handle, int bit ) {
+    chip[handle].driven &= ~(1 << bit);
+}
+
+void simPressButton( int handle, int bit ) {
+    simSetInput(handle, bit, LOW);
+}
+
+void simReleaseButton( int handle, int bit ) {
+    simReleaseInput(handle, bit);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Inspect register without counting a transaction
+ * ----------------------------------------------------------------------------------- */
+int simRegister( int handle, int reg ) {
+    if ( reg == MCP_GPIOA || reg == MCP_GPIOB ) {
+        return portLevel(&chip[handle], reg-MCP_GPIOA);
+    }
+    return chip[handle].reg[reg];
+}
+
+void simResetCounters( void ) {
+    simReads  = 0;
+    simWrites = 0;
+}
@@ -0,0 +1,48 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include "hardware.h"
+
+#ifndef hwSimulator_h
+#define hwSimulator_h
+
+/* ----------------------------------------------------------------------------------- *
+ * The simulator models up to eight MCP23017 chips at I2C address 0x20..0x27 on each
+ * of up to four buses. A chip is identified by its handle (8 * n + (address & 7) for
+ * the n-th bus opened), pins by their bit number 0..15 where 0..7 is port A and
+ * 8..15 is port B.
+ * ----------------------------------------------------------------------------------- */
+#define SIM_MAX_BUSES   4
+#define SIM_MAX_CHIPS   (8*SIM_MAX_BUSES)
+
+/* ----------------------------------------------------------------------------------- *
+ * Transaction counters of the simulated buses
+ * ----------------------------------------------------------------------------------- */
+extern atomic_ulong simReads;                           // register reads
+extern atomic_ulong simWrites;                          // register writes
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+void simSetInput    ( int chip, int bit, int level );   // drive input pin from outside
+void simReleaseInput( int chip, int bit );              // stop driving, pull up wins
+void simPressButton ( int chip, int bit );              // button to ground: pin LOW
+void simReleaseButton( int chip, int bit );             // button released
+int  simRegister    ( int chip, int reg );              // peek at register, no transaction
+void simResetCounters( void );                          // clear transaction counters
+
+#endif /* hwSimulator_h */
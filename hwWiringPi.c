@@ -0,0 +1,68 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <wiringPi.h>
+#include <wiringPiI2C.h>
+
+#include "hardware.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Open I2C device, the handle is the file descriptor returned by wiringPi
+ * ----------------------------------------------------------------------------------- */
+static int wpOpen( int bus, int address ) {
+    static bool initialized = false;
+    char device[32];
+
+    if ( !initialized ) {
+        wiringPiSetup();
+        initialized = true;
+    }
+    snprintf(device, sizeof(device), "/dev/i2c-%d", bus);
+    return wiringPiI2CSetupInterface(device, address);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Register access
+ * ----------------------------------------------------------------------------------- */
+static int wpReadReg( int fd, int reg ) {
+    return wiringPiI2CReadReg8(fd, reg);
+}
+
+static int wpReadReg16( int fd, int reg ) {
+    return wiringPiI2CReadReg16(fd, reg);             // SMBus word: low byte first
+}
+
+static int wpWriteReg( int fd, int reg, int value ) {
+    return wiringPiI2CWriteReg8(fd, reg, value);
+}
+
+static int wpWriteReg16( int fd, int reg, int value ) {
+    return wiringPiI2CWriteReg16(fd, reg, value);    // SMBus word: low byte first
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Backend definition
+ * ----------------------------------------------------------------------------------- */
+const hwBackend_t hwWiringPi = {
+    "wiringPi",
+    &wpOpen,
+    &wpReadReg,
+    &wpWriteReg,
+    &wpReadReg16,
+    &wpWriteReg16,
+};
@@ -0,0 +1,159 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+
+#include "journal.h"
+#include "persistState.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * The journal is a file of fixed size records, appended to on every step. It is
+ * truncated when a sequence starts, so it only holds the current run. A record torn
+ * by a crash fails its checksum and is ignored along with everything behind it.
+ * ----------------------------------------------------------------------------------- */
+#define JOURNAL_MAGIC  0x4a4e5259            // "YRNJ"
+
+#define REC_START      1
+#define REC_STEP       2
+#define REC_END        3
+
+typedef struct journalRecord_t {
+    uint32_t magic;
+    int32_t  sequence;                       // id as given in SEQUENCE <n>
+    int64_t  startTime;
+    int32_t  type;                           // REC_*
+    int32_t  step;
+    uint32_t checksum;                       // FNV-1a over all fields before it
+} journalRecord_t;
+
+static int fd = -1;                          // journal, opened for appending
+
+/* ----------------------------------------------------------------------------------- *
+ * Checksum of a record
+ * ----------------------------------------------------------------------------------- */
+static uint32_t checksum( const journalRecord_t *record ) {
+    const unsigned char *data = (const unsigned char*)record;
+    uint32_t hash = 2166136261u;
+    for ( size_t idx=0; idx<offsetof(journalRecord_t, checksum); idx++ ) {
+        hash = (hash ^ data[idx]) * 16777619u;
+    }
+    return hash;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Open journal file for appending
+ * ----------------------------------------------------------------------------------- */
+static bool openJournal( int flags ) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", stateDir, JOURNAL_FILE);
+    if ( fd >= 0 ) {
+        close(fd);
+    }
+    fd = open(path, O_CREAT|O_WRONLY|O_APPEND|O_CLOEXEC|flags, S_IRUSR|S_IWUSR);
+    if ( fd < 0 ) {
+        writeLog(LOG_ERR, "Error: Can't open %s [%s]", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Append record: one write and a data sync, a step is minutes apart from the next
+ * ----------------------------------------------------------------------------------- */
+static void append( int type, int sequence, time_t startTime, int step ) {
+    journalRecord_t record;
+
+    if ( fd < 0 && !openJournal(0) ) {
+        return;
+    }
+    memset(&record, 0, sizeof(record));
+    record.magic     = JOURNAL_MAGIC;
+    record.type      = type;
+    record.sequence  = sequence;
+    record.startTime = startTime;
+    record.step      = step;
+    record.checksum  = checksum(&record);
+
+    if ( write(fd, &record, sizeof(record)) != sizeof(record) || fdatasync(fd) ) {
+        writeLog(LOG_ERR, "Error: Can't write journal [%s]", strerror(errno));
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Replay journal to find out if a sequence was interrupted
+ * ----------------------------------------------------------------------------------- */
+bool journalRead( journal_t *journal ) {
+    journalRecord_t record;
+    char path[256];
+
+    memset(journal, 0, sizeof(journal_t));
+    journal->lastStep = -1;
+
+    snprintf(path, sizeof(path), "%s/%s", stateDir, JOURNAL_FILE);
+    int in = open(path, O_RDONLY);
+    if ( in < 0 ) {
+        return false;
+    }
+    while ( read(in, &record, sizeof(record)) == sizeof(record) ) {
+        if ( record.magic != JOURNAL_MAGIC || record.checksum != checksum(&record) ) {
+            writeLog(LOG_NOTICE, "Journal %s ends with a damaged record", path);
+            break;
+        }
+        switch ( record.type ) {
+            case REC_START:
+                journal->inProgress = true;
+                journal->sequence   = record.sequence;
+                journal->startTime  = (time_t)record.startTime;
+                journal->lastStep   = -1;
+                break;
+            case REC_STEP:
+                if ( record.step > journal->lastStep ) {
+                    journal->lastStep = record.step;
+                }
+                break;
+            case REC_END:
+                journal->inProgress = false;
+                break;
+        }
+    }
+    close(in);
+    return journal->inProgress;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Journal entries
+ * ----------------------------------------------------------------------------------- */
+void journalStart( int sequence, time_t startTime ) {
+    if ( openJournal(O_TRUNC) ) {
+        append(REC_START, sequence, startTime, -1);
+    }
+}
+
+void journalStep( int step ) {
+    append(REC_STEP, 0, 0, step);
+}
+
+void journalEnd( void ) {
+    append(REC_END, 0, 0, -1);
+}
@@ -0,0 +1,47 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+#include <time.h>
+
+#ifndef journal_h
+#define journal_h
+
+/* ----------------------------------------------------------------------------------- *
+ * Settings
+ * ----------------------------------------------------------------------------------- */
+#define JOURNAL_FILE  "journal"  // name of journal file in state directory
+
+/* ----------------------------------------------------------------------------------- *
+ * Progress of a sequence as found in the journal
+ * ----------------------------------------------------------------------------------- */
+typedef struct journal_t {
+    bool   inProgress;           // a sequence was running and did not end
+    int    sequence;             // sequence that was running
+    time_t startTime;            // time it was started
+    int    lastStep;             // last step done, -1 if none
+} journal_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+bool journalRead(journal_t *journal);             // last run, call once at startup
+void journalStart(int sequence, time_t startTime); // sequence started, starts new journal
+void journalStep(int step);                       // step done
+void journalEnd(void);                            // sequence ended or was stopped
+
+#endif /* journal_h */
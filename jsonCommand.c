@@ -0,0 +1,200 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "jsonCommand.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Scanner working directly on the payload buffer
+ * ----------------------------------------------------------------------------------- */
+typedef struct scanner_t {
+    const char *pos;             // next character
+    const char *end;             // end of buffer
+} scanner_t;
+
+static void skipSpace( scanner_t *s ) {
+    while ( s->pos < s->end && isspace((unsigned char)*s->pos) ) s->pos++;
+}
+
+static bool atChar( scanner_t *s, char c ) {
+    return s->pos < s->end && *s->pos == c;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Scan a string, result excludes the quotes. Escapes are skipped, not decoded.
+ * ----------------------------------------------------------------------------------- */
+static bool scanString( scanner_t *s, const char **str, int *len ) {
+    const char *start = ++s->pos;
+    while ( s->pos < s->end && *s->pos != '"' ) {
+        if ( *s->pos == '\\' ) s->pos++;
+        s->pos++;
+    }
+    if ( s->pos >= s->end ) {
+        return false;
+    }
+    *str = start;
+    *len = (int)(s->pos - start);
+    s->pos++;
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Scan number or literal (true, false, null)
+ * ----------------------------------------------------------------------------------- */
+static bool scanLiteral( scanner_t *s, const char **str, int *len ) {
+    const char *start = s->pos;
+    while ( s->pos < s->end && (isalnum((unsigned char)*s->pos) || *s->pos == '-' || *s->pos == '+' || *s->pos == '.') ) {
+        s->pos++;
+    }
+    *str = start;
+    *len = (int)(s->pos - start);
+    return *len > 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Scan string or literal
+ * ----------------------------------------------------------------------------------- */
+static bool scanScalar( scanner_t *s, const char **str, int *len ) {
+    return atChar(s, '"') ? scanString(s, str, len) : scanLiteral(s, str, len);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Skip any value, including nested objects and arrays
+ * ----------------------------------------------------------------------------------- */
+static bool skipValue( scanner_t *s ) {
+    const char *str;
+    int len, depth = 0;
+
+    if ( !atChar(s, '{') && !atChar(s, '[') ) {
+        return scanScalar(s, &str, &len);
+    }
+    while ( s->pos < s->end ) {
+        if ( *s->pos == '"' ) {
+            if ( !scanString(s, &str, &len) ) return false;
+            continue;
+        }
+        if ( *s->pos == '{' || *s->pos == '[' ) depth++;
+        if ( *s->pos == '}' || *s->pos == ']' ) depth--;
+        s->pos++;
+        if ( depth == 0 ) return true;
+    }
+    return false;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Compare token with upper case word, ignoring case
+ * ----------------------------------------------------------------------------------- */
+static bool isWord( const char *str, int len, const char *word ) {
+    int idx;
+    for ( idx=0; idx<len && word[idx]; idx++ ) {
+        if ( toupper((unsigned char)str[idx]) != word[idx] ) return false;
+    }
+    return idx == len && word[idx] == '\0';
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Interpret token as state
+ * ----------------------------------------------------------------------------------- */
+static int stateValue( const char *str, int len ) {
+    if ( isWord(str, len, "ON")  || isWord(str, len, "1") || isWord(str, len, "TRUE") )  return CMD_ON;
+    if ( isWord(str, len, "OFF") || isWord(str, len, "0") || isWord(str, len, "FALSE") ) return CMD_OFF;
+    return CMD_UNKNOWN;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Interpret token as non negative number
+ * ----------------------------------------------------------------------------------- */
+static bool intValue( const char *str, int len, int *value ) {
+    int result = 0;
+    if ( len == 0 ) return false;
+    for ( int idx=0; idx<len; idx++ ) {
+        if ( !isdigit((unsigned char)str[idx]) || result > (INT_MAX-9)/10 ) return false;
+        result = result*10 + (str[idx]-'0');
+    }
+    *value = result;
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Parse command payload, returns false on syntax errors or if no state was given
+ * ----------------------------------------------------------------------------------- */
+bool parseCommand( const char *payload, int length, command_t *command ) {
+    scanner_t   s = { payload, payload+length };
+    const char *str;
+    int         len;
+
+    command->state    = CMD_UNKNOWN;
+    command->duration = 0;
+    command->id       = NULL;
+    command->idLen    = 0;
+
+    skipSpace(&s);
+    if ( !atChar(&s, '{') ) {
+        // bare value: ON, "OFF", 1 ...
+        if ( !scanScalar(&s, &str, &len) ) return false;
+        command->state = stateValue(str, len);
+    } else {
+        s.pos++;
+        skipSpace(&s);
+        if ( atChar(&s, '}') ) {
+            s.pos++;
+        } else for ( ;; ) {
+            const char *key;
+            int keyLen;
+
+            // "key" :
+            skipSpace(&s);
+            if ( !atChar(&s, '"') || !scanString(&s, &key, &keyLen) ) return false;
+            skipSpace(&s);
+            if ( !atChar(&s, ':') ) return false;
+            s.pos++;
+            skipSpace(&s);
+
+            // value
+            if ( isWord(key, keyLen, "STATE") ) {
+                if ( !scanScalar(&s, &str, &len) ) return false;
+                command->state = stateValue(str, len);
+            } else if ( isWord(key, keyLen, "DURATION") ) {
+                if ( !scanScalar(&s, &str, &len) || !intValue(str, len, &command->duration) ) return false;
+            } else if ( isWord(key, keyLen, "ID") ) {
+                if ( !scanScalar(&s, &str, &len) ) return false;
+                command->id    = str;
+                command->idLen = len;
+            } else if ( !skipValue(&s) ) {
+                return false;
+            }
+
+            // , or }
+            skipSpace(&s);
+            if ( atChar(&s, ',') ) {
+                s.pos++;
+            } else if ( atChar(&s, '}') ) {
+                s.pos++;
+                break;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    // nothing but white space may follow
+    skipSpace(&s);
+    return s.pos == s.end && command->state != CMD_UNKNOWN;
+}
@@ -0,0 +1,55 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+
+#ifndef jsonCommand_h
+#define jsonCommand_h
+
+/* ----------------------------------------------------------------------------------- *
+ * Values for command_t.state
+ * ----------------------------------------------------------------------------------- */
+#define CMD_UNKNOWN   -1
+#define CMD_OFF        0
+#define CMD_ON         1
+
+/* ----------------------------------------------------------------------------------- *
+ * A command received over MQTT:
+ *
+ *   {"state":"ON", "duration":15, "id":"abc"}
+ *
+ *   state     ON/OFF, 1/0 or true/false (string, number or literal, any case)
+ *   duration  optional, minutes until the valve is switched off again
+ *   id        optional request id, echoed in the log
+ *
+ * Keys are case insensitive, unknown keys are ignored. A payload that is no JSON
+ * object is taken as bare state value (ON, OFF, ...). Strings in the result point
+ * into the payload, nothing is copied or allocated.
+ * ----------------------------------------------------------------------------------- */
+typedef struct command_t {
+    int         state;           // CMD_ON, CMD_OFF or CMD_UNKNOWN
+    int         duration;        // minutes, 0 if not given
+    const char *id;              // request id, NOT zero terminated
+    int         idLen;           // length of request id, 0 if not given
+} command_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+bool parseCommand(const char *payload, int length, command_t *command);
+
+#endif /* jsonCommand_h */
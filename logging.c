@@ -17,14 +17,21 @@
 /* *********************************************************************************** */
 
 #include "logging.h"
+#include "clockSource.h"
 #include <syslog.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 
 /* ----------------------------------------------------------------------------------- *
  * local data
  * ----------------------------------------------------------------------------------- */
-static int  logLevel  = LOG_ERR;
-static bool useSyslog = true;
+int         currentLogLevel = LOG_ERR;          // checked inline by writeLog()
+static bool useSyslog       = true;
 static const char * logLevelText[] = {  "emergency",
                                         "alert",
                                         "citical",
@@ -35,6 +42,436 @@ static const char * logLevelText[] = {  "emergency",
                                         "debug"
 };
 
+/* ----------------------------------------------------------------------------------- *
+ * Asynchronous mode: writeLog only packs level, time, format pointer and arguments
+ * into a fixed size record. Strings are copied into the record since they may be
+ * gone by the time the record is formatted. The log thread does formatting and
+ * output.
+ *
+ * Records live in a bounded multi producer, single consumer ring (D. Vyukov): each
+ * cell carries a sequence number telling whether it is free for position n
+ * (sequence == n) or holds the record for position n (sequence == n+1). Producers
+ * claim positions with a CAS, a full ring drops the record and counts it.
+ * ----------------------------------------------------------------------------------- */
+#define ARG_INT     0            // any integer, and '*' width/precision
+#define ARG_DOUBLE  1
+#define ARG_PTR     2
+#define ARG_STR     3            // offset into strings[]
+
+typedef struct logRecord_t {
+    atomic_size_t   sequence;                // position this cell is free/full for
+    int             level;
+    struct timespec time;
+    const char     *format;                  // NULL: strings[] holds formatted text
+    int             numArgs;
+    unsigned char   type[LOG_MAX_ARGS];
+    union {
+        long long   i;
+        double      d;
+        const void *p;
+        int         offset;
+    } arg[LOG_MAX_ARGS];
+    char            strings[LOG_STRING_SPACE];
+} logRecord_t;
+
+static logRecord_t  *ring      = NULL;
+static atomic_size_t enqueuePos;
+static size_t        dequeuePos;             // log thread only
+static atomic_ulong  overflows;              // records dropped because ring was full
+static atomic_bool   logRunning = false;
+static pthread_t     logThread;
+
+/* ----------------------------------------------------------------------------------- *
+ * Printf conversion specification
+ * ----------------------------------------------------------------------------------- */
+#define LEN_NONE  0
+#define LEN_HH    1
+#define LEN_H     2
+#define LEN_L     3
+#define LEN_LL    4
+#define LEN_Z     5
+#define LEN_J     6
+#define LEN_T     7
+#define LEN_BIG_L 8
+
+#define PREC_STAR -2
+
+typedef struct logSpec_t {
+    const char *start;           // '%'
+    int         flagsLen;        // length of '%', flags, width and precision
+    int         stars;           // number of '*' arguments
+    int         precision;       // -1: none, PREC_STAR: taken from the last '*' argument
+    int         length;          // LEN_*
+    char        conversion;      // d, s, f, ...
+} logSpec_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Find next conversion in format, NULL if there is none. Returns end of conversion.
+ * ----------------------------------------------------------------------------------- */
+static const char *nextSpec( const char *format, logSpec_t *spec ) {
+    const char *pos = strchr(format, '%');
+    if ( !pos ) {
+        return NULL;
+    }
+    spec->start = pos++;
+    spec->stars     = 0;
+    spec->precision = -1;
+    while ( *pos && strchr("-+ #0", *pos) ) pos++;                   // flags
+    while ( *pos && (isdigit((unsigned char)*pos) || *pos == '*') ) {
+        if ( *pos == '*' ) spec->stars++;                           // width
+        pos++;
+    }
+    if ( *pos == '.' ) {                                            // precision
+        pos++;
+        if ( *pos == '*' ) {
+            spec->stars++;
+            spec->precision = PREC_STAR;
+            pos++;
+        } else {
+            spec->precision = 0;
+            while ( isdigit((unsigned char)*pos) ) {
+                spec->precision = spec->precision*10 + (*pos++ - '0');
+            }
+        }
+    }
+    spec->flagsLen = (int)(pos - spec->start);
+    spec->length   = LEN_NONE;
+    switch ( *pos ) {
+        case 'h': spec->length = (pos[1] == 'h') ? LEN_HH : LEN_H; break;
+        case 'l': spec->length = (pos[1] == 'l') ? LEN_LL : LEN_L; break;
+        case 'z': spec->length = LEN_Z;     break;
+        case 'j': spec->length = LEN_J;     break;
+        case 't': spec->length = LEN_T;     break;
+        case 'L': spec->length = LEN_BIG_L; break;
+    }
+    if ( spec->length == LEN_HH || spec->length == LEN_LL ) pos += 2;
+    else if ( spec->length != LEN_NONE ) pos++;
+    spec->conversion = *pos;
+    return *pos ? pos+1 : pos;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Pack arguments into record, false if the format can't be handled that way
+ * ----------------------------------------------------------------------------------- */
+static bool packArgs( logRecord_t *record, const char *format, va_list valist ) {
+    logSpec_t spec;
+    int       used = 0;
+
+    record->numArgs = 0;
+    while ( (format = nextSpec(format, &spec)) ) {
+        if ( spec.conversion == '%' ) {
+            continue;
+        }
+        if ( record->numArgs + spec.stars >= LOG_MAX_ARGS ) {
+            return false;
+        }
+        for ( int star=0; star<spec.stars; star++ ) {
+            record->type[record->numArgs]    = ARG_INT;
+            record->arg[record->numArgs++].i = va_arg(valist, int);
+        }
+
+        int arg = record->numArgs++;
+        record->type[arg] = ARG_INT;
+        switch ( spec.conversion ) {
+            case 'd': case 'i':
+                switch ( spec.length ) {
+                    case LEN_HH: record->arg[arg].i = (signed char)va_arg(valist, int); break;
+                    case LEN_H:  record->arg[arg].i = (short)va_arg(valist, int);       break;
+                    case LEN_L:  record->arg[arg].i = va_arg(valist, long);             break;
+                    case LEN_LL: record->arg[arg].i = va_arg(valist, long long);        break;
+                    case LEN_Z:  record->arg[arg].i = va_arg(valist, ssize_t);          break;
+                    case LEN_J:  record->arg[arg].i = va_arg(valist, intmax_t);         break;
+                    case LEN_T:  record->arg[arg].i = va_arg(valist, ptrdiff_t);        break;
+                    default:     record->arg[arg].i = va_arg(valist, int);              break;
+                }
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                switch ( spec.length ) {
+                    case LEN_HH: record->arg[arg].i = (unsigned char)va_arg(valist, int);       break;
+                    case LEN_H:  record->arg[arg].i = (unsigned short)va_arg(valist, int);      break;
+                    case LEN_L:  record->arg[arg].i = va_arg(valist, unsigned long);            break;
+                    case LEN_LL: record->arg[arg].i = va_arg(valist, unsigned long long);       break;
+                    case LEN_Z:  record->arg[arg].i = va_arg(valist, size_t);                   break;
+                    case LEN_J:  record->arg[arg].i = va_arg(valist, uintmax_t);                break;
+                    case LEN_T:  record->arg[arg].i = va_arg(valist, ptrdiff_t);                break;
+                    default:     record->arg[arg].i = va_arg(valist, unsigned int);             break;
+                }
+                break;
+            case 'c':
+                record->arg[arg].i = va_arg(valist, int);
+                break;
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                record->type[arg]  = ARG_DOUBLE;
+                record->arg[arg].d = (spec.length == LEN_BIG_L) ? (double)va_arg(valist, long double)
+                                                                : va_arg(valist, double);
+                break;
+            case 'p':
+                record->type[arg]  = ARG_PTR;
+                record->arg[arg].p = va_arg(valist, void*);
+                break;
+            case 's': {
+                // with a precision the string needn't be terminated, copy no more
+                const char *str = va_arg(valist, const char*);
+                int         max = spec.precision == PREC_STAR ? (int)record->arg[arg-1].i
+                                                              : spec.precision;
+                size_t      len = !str ? 6 : max >= 0 ? strnlen(str, max) : strlen(str);
+                if ( len > LOG_STRING_SPACE-1-used ) {
+                    len = LOG_STRING_SPACE-1-used;     // truncate
+                }
+                memcpy(record->strings+used, str ? str : "(null)", len);
+                record->strings[used+len] = '\0';
+                record->type[arg]       = ARG_STR;
+                record->arg[arg].offset = used;
+                used += len+1;
+                if ( used >= LOG_STRING_SPACE ) {
+                    used = LOG_STRING_SPACE-1;         // following strings end up empty
+                }
+                break;
+            }
+            default:                                   // %n, %ls, ...
+                return false;
+        }
+    }
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Format record into buffer, the reverse of packArgs
+ * ----------------------------------------------------------------------------------- */
+static void formatRecord( const logRecord_t *record, char *buffer, size_t size ) {
+    const char *format = record->format;
+    const char *next;
+    logSpec_t   spec;
+    size_t      len = 0;
+    int         arg = 0;
+
+    if ( !format ) {
+        snprintf(buffer, size, "%s", record->strings);
+        return;
+    }
+    while ( len < size-1 ) {
+        next = nextSpec(format, &spec);
+
+        // literal text up to the conversion
+        size_t literal = next ? (size_t)(spec.start - format) : strlen(format);
+        if ( literal > size-1-len ) {
+            literal = size-1-len;
+        }
+        memcpy(buffer+len, format, literal);
+        len += literal;
+        if ( !next || len >= size-1 ) {
+            break;
+        }
+        format = next;
+
+        if ( spec.conversion == '%' ) {
+            buffer[len++] = '%';
+            continue;
+        }
+
+        // rebuild conversion with the argument type used in the record
+        char conversion[32];
+        int  specLen = spec.flagsLen < 24 ? spec.flagsLen : 24;
+        memcpy(conversion, spec.start, specLen);
+        if ( strchr("diuoxX", spec.conversion) ) {
+            conversion[specLen++] = 'l';
+            conversion[specLen++] = 'l';
+        }
+        conversion[specLen++] = spec.conversion;
+        conversion[specLen]   = '\0';
+
+        int star[2] = { 0, 0 };
+        for ( int idx=0; idx<spec.stars; idx++ ) {
+            star[idx & 1] = (int)record->arg[arg++].i;
+        }
+        char *out   = buffer+len;
+        size_t room = size-len;
+        int written = 0;
+
+#define EMIT(value) \
+        written = spec.stars == 0 ? snprintf(out, room, conversion, value) : \
+                  spec.stars == 1 ? snprintf(out, room, conversion, star[0], value) : \
+                                    snprintf(out, room, conversion, star[0], star[1], value)
+
+        switch ( record->type[arg] ) {
+            case ARG_DOUBLE: EMIT(record->arg[arg].d); break;
+            case ARG_PTR:    EMIT(record->arg[arg].p); break;
+            case ARG_STR:    EMIT(record->strings + record->arg[arg].offset); break;
+            default:
+                if ( spec.conversion == 'c' ) {
+                    EMIT((int)record->arg[arg].i);
+                } else {
+                    EMIT(record->arg[arg].i);
+                }
+                break;
+        }
+#undef EMIT
+        arg++;
+        if ( written > 0 ) {
+            len += ((size_t)written < room) ? (size_t)written : room-1;
+        }
+    }
+    buffer[len] = '\0';
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Write a formatted message to syslog or stdout
+ * ----------------------------------------------------------------------------------- */
+static void writeLine( int level, time_t when, const char *text ) {
+    static time_t cachedTime = 0;                // timestamp is formatted once per second
+    static char   cachedText[24];
+
+    if ( useSyslog ) {
+        syslog(level, "<%s> %s\n", logLevelText[level], text);
+    } else {
+        if ( when != cachedTime ) {
+            struct tm timestamp;
+            localtime_r(&when, &timestamp);
+            strftime(cachedText, sizeof(cachedText), "%Y-%m-%d %H:%M:%S", &timestamp);
+            cachedTime = when;
+        }
+        printf("%s <%s> %s\n", cachedText, logLevelText[level], text);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Repeated messages: a message equal to the one before is only counted. The count
+ * is written as "last message repeated N times" when a different message comes in,
+ * or LOG_REPEAT_INTERVAL seconds after the first repetition.
+ * ----------------------------------------------------------------------------------- */
+static pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER;
+static char            lastText[LOG_LINE_LEN];
+static int             lastLevel   = -1;
+static int             repeated    = 0;
+static time_t          repeatStart = 0;
+
+static void flushRepeated( time_t when ) {
+    if ( repeated ) {
+        char text[64];
+        snprintf(text, sizeof(text), "last message repeated %d times", repeated);
+        writeLine(lastLevel, when, text);
+        repeated = 0;
+    }
+}
+
+static void checkRepeated( time_t when ) {
+    pthread_mutex_lock(&outputLock);
+    if ( repeated && when - repeatStart >= LOG_REPEAT_INTERVAL ) {
+        flushRepeated(when);
+    }
+    pthread_mutex_unlock(&outputLock);
+}
+
+static void outputLine( int level, time_t when, const char *text ) {
+    pthread_mutex_lock(&outputLock);
+    if ( level == lastLevel && !strcmp(text, lastText) ) {
+        if ( !repeated++ ) {
+            repeatStart = when;
+        }
+        if ( when - repeatStart >= LOG_REPEAT_INTERVAL ) {
+            flushRepeated(when);
+        }
+    } else {
+        flushRepeated(when);
+        writeLine(level, when, text);
+        lastLevel = level;
+        snprintf(lastText, sizeof(lastText), "%s", text);
+    }
+    pthread_mutex_unlock(&outputLock);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Format and write all queued records, returns number of records written
+ * ----------------------------------------------------------------------------------- */
+static int drainLog( void ) {
+    static unsigned long reported = 0;
+    int written = 0;
+
+    for ( ;; ) {
+        logRecord_t *record = &ring[dequeuePos & (LOG_RING_LEN-1)];
+        if ( atomic_load_explicit(&record->sequence, memory_order_acquire) != dequeuePos+1 ) {
+            break;                                   // empty
+        }
+        char text[LOG_LINE_LEN];
+        formatRecord(record, text, sizeof(text));
+        outputLine(record->level, record->time.tv_sec, text);
+        atomic_store_explicit(&record->sequence, dequeuePos+LOG_RING_LEN, memory_order_release);
+        dequeuePos++;
+        written++;
+    }
+
+    unsigned long lost = atomic_load(&overflows);
+    if ( lost != reported ) {
+        char text[64];
+        snprintf(text, sizeof(text), "%lu log messages lost", lost-reported);
+        outputLine(LOG_WARNING, clockWall(), text);
+        reported = lost;
+    }
+    if ( written && !useSyslog ) {
+        fflush(stdout);
+    }
+    return written;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Log thread: drain ring periodically, writing is never urgent
+ * ----------------------------------------------------------------------------------- */
+static void *logLoop( void *arg ) {
+    struct timespec period = { 0, LOG_DRAIN_MS * 1000000L };
+    while ( atomic_load(&logRunning) ) {
+        if ( !drainLog() ) {
+            checkRepeated(clockWall());
+        }
+        nanosleep(&period, NULL);
+    }
+    drainLog();
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Queue log record, never blocks
+ * ----------------------------------------------------------------------------------- */
+static void queueLog( int level, const char *format, va_list valist ) {
+    size_t       pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+    logRecord_t *record;
+
+    for ( ;; ) {
+        record = &ring[pos & (LOG_RING_LEN-1)];
+        size_t   sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        intptr_t diff     = (intptr_t)sequence - (intptr_t)pos;
+        if ( diff == 0 ) {
+            if ( atomic_compare_exchange_weak_explicit(&enqueuePos, &pos, pos+1,
+                                                       memory_order_relaxed, memory_order_relaxed) ) {
+                break;                               // cell claimed
+            }
+        } else if ( diff < 0 ) {
+            atomic_fetch_add(&overflows, 1);         // full
+            return;
+        } else {
+            pos = atomic_load_explicit(&enqueuePos, memory_order_relaxed);
+        }
+    }
+
+    record->level = level;
+    if ( clockIsVirtual() ) {
+        record->time.tv_sec  = clockWall();
+        record->time.tv_nsec = 0;
+    } else {
+        clock_gettime(CLOCK_REALTIME_COARSE, &record->time);
+    }
+    record->format = format;
+
+    va_list args;
+    va_copy(args, valist);
+    bool packed = packArgs(record, format, args);
+    va_end(args);
+    if ( !packed ) {                                 // fall back to formatting right here
+        record->format = NULL;
+        vsnprintf(record->strings, sizeof(record->strings), format, valist);
+    }
+    atomic_store_explicit(&record->sequence, pos+1, memory_order_release);
+}
+
 /* ----------------------------------------------------------------------------------- *
  * init logging
  * ----------------------------------------------------------------------------------- */
@@ -46,45 +483,85 @@ void initLog( bool syslog ) {
     }
 }
 
+/* ----------------------------------------------------------------------------------- *
+ * Switch to asynchronous logging, has to be called after forking into background
+ * ----------------------------------------------------------------------------------- */
+bool startLogThread( void ) {
+    if ( atomic_load(&logRunning) ) {
+        return true;
+    }
+    ring = calloc(LOG_RING_LEN, sizeof(logRecord_t));
+    if ( !ring ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        return false;
+    }
+    for ( size_t pos=0; pos<LOG_RING_LEN; pos++ ) {
+        atomic_init(&ring[pos].sequence, pos);
+    }
+    atomic_init(&enqueuePos, 0);
+    dequeuePos = 0;
+
+    // signals are for the event loop's signalfd, the thread starts with all blocked
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    atomic_store(&logRunning, true);
+    int err = pthread_create(&logThread, NULL, &logLoop, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if ( err ) {
+        atomic_store(&logRunning, false);
+        free(ring);
+        ring = NULL;
+        writeLog(LOG_ERR, "Error: Can't start log thread, logging synchronously");
+        return false;
+    }
+    atexit(&stopLogThread);                          // don't lose the last messages
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Write what is queued and return to synchronous logging
+ * ----------------------------------------------------------------------------------- */
+void stopLogThread( void ) {
+    if ( atomic_exchange(&logRunning, false) ) {
+        pthread_join(logThread, NULL);
+        // ring is kept, a thread may still be about to write into it
+    }
+}
+
 /* ----------------------------------------------------------------------------------- *
  * set Loglevel
  * ----------------------------------------------------------------------------------- */
 int setLogLevel( int level ) {
-    logLevel = level;
-    if (logLevel > LOG_DEBUG ) {
-        logLevel = LOG_DEBUG;
+    currentLogLevel = level;
+    if (currentLogLevel > LOG_DEBUG ) {
+        currentLogLevel = LOG_DEBUG;
     }
-    writeLog(LOG_NOTICE, "Set log level to %s", logLevelText[level]);
-    return logLevel;
+    writeLog(LOG_NOTICE, "Set log level to %s", logLevelText[currentLogLevel]);
+    return currentLogLevel;
 }
     
 /* ----------------------------------------------------------------------------------- *
  * return Loglevel
  * ----------------------------------------------------------------------------------- */
 int getLogLevel( void ) {
-    return logLevel;
+    return currentLogLevel;
 }
 
 /* ----------------------------------------------------------------------------------- *
- * write log entry
+ * write log entry, level has been checked by the writeLog() macro
  * ----------------------------------------------------------------------------------- */
-void writeLog( int level, const char* format, ...) {
+void writeLogEntry( int level, const char* format, ...) {
     va_list valist;
-    if( level <= logLevel ) {
-        time_t now = time(NULL);
-        struct tm *timestamp = localtime(&now);
-        char fmt[512];
-        va_start(valist, format);
-    
-        if ( useSyslog ) {
-            sprintf(fmt, "<%s> %s\n", logLevelText[level], format);
-            vsyslog( level, fmt, valist );
-        } else {
-            sprintf(fmt, "%04d-%02d-%02d %02d:%02d:%02d <%s> %s\n",
-                    timestamp->tm_year+1900, timestamp->tm_mon+1, timestamp->tm_mday,
-                    timestamp->tm_hour, timestamp->tm_min, timestamp->tm_sec,
-                    logLevelText[level] , format);
-            vprintf( fmt, valist );
-        }
+    va_start(valist, format);
+
+    if ( atomic_load_explicit(&logRunning, memory_order_relaxed) ) {
+        queueLog(level, format, valist);
+    } else {
+        char text[LOG_LINE_LEN];
+        vsnprintf(text, sizeof(text), format, valist);
+        outputLine(level, clockWall(), text);
     }
+    va_end(valist);
 }
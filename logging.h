@@ -38,6 +38,37 @@
   LOG_DEBUG    A message useful for debugging programs.
  */
 
+/* ----------------------------------------------------------------------------------- *
+ * Asynchronous logging: records keep a pointer to the format and are formatted later
+ * by the log thread, so formats must be string literals. Strings passed for %s are
+ * copied into the record.
+ * ----------------------------------------------------------------------------------- */
+#define LOG_RING_LEN      256    // queued records, power of two
+#define LOG_MAX_ARGS        8    // arguments per record, more are formatted by the caller
+#define LOG_STRING_SPACE  160    // bytes per record for copies of %s arguments
+#define LOG_LINE_LEN      512    // longest formatted message
+#define LOG_DRAIN_MS       20    // log thread writes queued records this often
+#define LOG_REPEAT_INTERVAL 60   // seconds until "last message repeated" is written
+
+/* ----------------------------------------------------------------------------------- *
+ * Messages above LOG_COMPILE_LEVEL are removed at compile time, e.g. build with
+ * -DLOG_COMPILE_LEVEL=LOG_INFO to drop all debug messages. The rest is checked
+ * against the runtime log level before any arguments are evaluated. Pasting "" in
+ * front of the format makes anything but a string literal a compile error.
+ * ----------------------------------------------------------------------------------- */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL  LOG_DEBUG
+#endif
+
+extern int currentLogLevel;
+
+#define writeLog(level, ...)                                                    \
+    do {                                                                         \
+        if ( (level) <= LOG_COMPILE_LEVEL && (level) <= currentLogLevel ) {      \
+            writeLogEntry((level), "" __VA_ARGS__);                               \
+        }                                                                        \
+    } while (0)
+
 /* ----------------------------------------------------------------------------------- *
  * Prototypes
  * ----------------------------------------------------------------------------------- */
@@ -45,6 +76,8 @@ int setLogLevel( int level );
 int getLogLevel( void );
 
 void initLog( bool useSyslog );
-void writeLog( int logLevel, const char* format, ... );
+bool startLogThread( void );     // format and write log messages in background thread
+void stopLogThread( void );      // write queued messages, back to synchronous logging
+void writeLogEntry( int logLevel, const char* format, ... ) __attribute__((format(printf, 2, 3)));
 
 #endif /* logging_h */
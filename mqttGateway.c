@@ -16,22 +16,82 @@
 /* *********************************************************************************** */
 #include <mosquitto.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/eventfd.h>
 
 #include "mqttGateway.h"
+#include "spscQueue.h"
 #include "logging.h"
+#include "trace.h"
 
 /* ----------------------------------------------------------------------------------- *
  * Handle to broker
  * ----------------------------------------------------------------------------------- */
 static struct mosquitto *mosq = NULL;
 
+/* ----------------------------------------------------------------------------------- *
+ * Network thread: the only thread talking to libmosquitto once it is running.
+ * Messages are handed over in both directions through lock free queues, so neither
+ * side ever waits for the other.
+ * ----------------------------------------------------------------------------------- */
+typedef struct mqttMessage_t {
+    char topic[MQTT_TOPIC_LEN];          // zero terminated
+    char payload[MQTT_PAYLOAD_LEN];      // zero terminated
+    int  payloadlen;
+    bool retain;
+} mqttMessage_t;
+
+static spscQueue_t   inbound;                 // network thread -> control loop
+static spscQueue_t   outbound;                // control loop -> network thread
+static atomic_ulong  droppedIncoming;         // messages lost because inbound was full
+static pthread_t     networkThread;
+static atomic_bool   running      = false;
+static int           wakeupFd     = -1;       // wakes network thread for outbound data
+static void        (*notify)(void) = NULL;    // wakes control loop for inbound data
+
+/* ----------------------------------------------------------------------------------- *
+ * Connection state, owned by the network thread. While the broker is unreachable
+ * outbound messages are kept in a ring holding the latest message per topic.
+ * ----------------------------------------------------------------------------------- */
+static bool          connected    = false;    // CONNACK received
+static int           retryDelay   = 0;        // current backoff in ms, 0 after success
+static uint64_t      retryAt      = 0;        // next connect attempt, 0 if none planned
+static unsigned int  jitterSeed;
+
+static mqttMessage_t pending[MQTT_PENDING_LEN];
+static int           pendingFirst   = 0;      // oldest entry
+static int           pendingCount   = 0;
+static unsigned long pendingDropped = 0;      // overwritten because ring was full
+
 /* ----------------------------------------------------------------------------------- *
  * List of topics to subscribe to along with handlers to call on reception
  * ----------------------------------------------------------------------------------- */
 static        mqttIncoming_t *subscriptionList = NULL;
 
+/* ----------------------------------------------------------------------------------- *
+ * Subscriptions compiled into a trie with one node per topic level. Wildcards get
+ * their own child pointers so they don't need to be searched for.
+ * ----------------------------------------------------------------------------------- */
+typedef struct topicNode_t {
+    char               *level;       // name of this topic level
+    struct topicNode_t *children;    // first child with a plain name
+    struct topicNode_t *next;        // next sibling
+    struct topicNode_t *plus;        // child for '+'
+    struct topicNode_t *hash;        // child for '#'
+    mqttIncoming_t     *handler;     // subscription ending at this node
+} topicNode_t;
+
+static topicNode_t *topicTree = NULL;
+
 /* ----------------------------------------------------------------------------------- *
  * Local prototypes
  * ----------------------------------------------------------------------------------- */
@@ -42,26 +102,372 @@ static void mqttLog(struct mosquitto *mosq, void *user_data, int logLevel, const
  * ----------------------------------------------------------------------------------- */
 void mqttLog(struct mosquitto *mosq, void *user_data, int logLevel, const char *logMessage) {
 #ifdef MQTT_DEBUG
-    writeLog(LOG_INFO, logMessage);
+    writeLog(LOG_INFO, "%s", logMessage);
 #endif
 }
 
 /* ----------------------------------------------------------------------------------- *
- * Dispatch incoming messages
+ * Find or create child node for a topic level of the given length
+ * ----------------------------------------------------------------------------------- */
+static topicNode_t *addLevel( topicNode_t *node, const char *level, size_t len ) {
+    topicNode_t **slot;
+
+    if ( len == 1 && *level == '+' ) {
+        slot = &node->plus;
+    } else if ( len == 1 && *level == '#' ) {
+        slot = &node->hash;
+    } else {
+        for ( slot = &node->children; *slot; slot = &(*slot)->next ) {
+            if ( !strncmp((*slot)->level, level, len) && (*slot)->level[len] == '\0' ) {
+                return *slot;
+            }
+        }
+    }
+    if ( !*slot ) {
+        *slot = calloc(1, sizeof(topicNode_t));
+        if ( *slot ) {
+            (*slot)->level = strndup(level, len);
+        }
+    }
+    return *slot;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Add subscription to topic tree
+ * ----------------------------------------------------------------------------------- */
+static bool addSubscription( mqttIncoming_t *subscription ) {
+    topicNode_t *node  = topicTree;
+    const char  *level = subscription->topic;
+
+    for ( ;; ) {
+        size_t len = strcspn(level, "/");
+        node = addLevel(node, level, len);
+        if ( !node ) {
+            writeLog(LOG_ERR, "Error: Out of memory.");
+            return false;
+        }
+        if ( level[len] == '\0' ) {
+            break;
+        }
+        level += len+1;
+    }
+    node->handler = subscription;
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Find subscription matching a topic: plain names first, then '+' and '#'
+ * ----------------------------------------------------------------------------------- */
+static mqttIncoming_t *matchTopic( const topicNode_t *node, const char *level );
+
+static mqttIncoming_t *matchNode( const topicNode_t *node, const char *rest ) {
+    if ( rest ) {
+        return matchTopic(node, rest);
+    }
+    // end of topic, "a/#" matches "a" as well
+    return node->handler ? node->handler : node->hash ? node->hash->handler : NULL;
+}
+
+static mqttIncoming_t *matchTopic( const topicNode_t *node, const char *level ) {
+    mqttIncoming_t *match = NULL;
+    size_t len = strcspn(level, "/");
+    const char *rest = level[len] ? level+len+1 : NULL;
+
+    for ( const topicNode_t *child = node->children; child && !match; child = child->next ) {
+        if ( !strncmp(child->level, level, len) && child->level[len] == '\0' ) {
+            match = matchNode(child, rest);
+        }
+    }
+    if ( !match && node->plus ) {
+        match = matchNode(node->plus, rest);
+    }
+    if ( !match && node->hash ) {
+        match = node->hash->handler;
+    }
+    return match;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Free topic tree
+ * ----------------------------------------------------------------------------------- */
+static void freeTopicTree( topicNode_t *node ) {
+    while ( node ) {
+        topicNode_t *next = node->next;
+        freeTopicTree(node->children);
+        freeTopicTree(node->plus);
+        freeTopicTree(node->hash);
+        free(node->level);
+        free(node);
+        node = next;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Copy incoming message to inbound queue (network thread)
+ * ----------------------------------------------------------------------------------- */
+static void receiveMessage(struct mosquitto *mos, void *userData, const struct mosquitto_message *message) {
+    mqttMessage_t *slot     = spscWriteSlot(&inbound);
+    size_t         topicLen = strlen(message->topic);
+
+    if ( !slot || topicLen >= MQTT_TOPIC_LEN || message->payloadlen >= MQTT_PAYLOAD_LEN ) {
+        atomic_fetch_add(&droppedIncoming, 1);
+        return;
+    }
+    memcpy(slot->topic, message->topic, topicLen+1);
+    memcpy(slot->payload, message->payload, message->payloadlen);
+    slot->payload[message->payloadlen] = '\0';
+    slot->payloadlen = message->payloadlen;
+    spscCommit(&inbound);
+
+    if ( notify ) {
+        notify();
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Monotonic time in ms
+ * ----------------------------------------------------------------------------------- */
+static uint64_t nowMs( void ) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Keep message until the broker is back, replacing an older one for the same topic
+ * ----------------------------------------------------------------------------------- */
+static void keepPending( const mqttMessage_t *message ) {
+    for ( int entry=0; entry<pendingCount; entry++ ) {
+        mqttMessage_t *kept = &pending[(pendingFirst+entry) % MQTT_PENDING_LEN];
+        if ( !strcmp(kept->topic, message->topic) ) {
+            *kept = *message;
+            return;
+        }
+    }
+    if ( pendingCount == MQTT_PENDING_LEN ) {   // full, drop oldest
+        pendingFirst = (pendingFirst+1) % MQTT_PENDING_LEN;
+        pendingCount--;
+        pendingDropped++;
+    }
+    pending[(pendingFirst+pendingCount) % MQTT_PENDING_LEN] = *message;
+    pendingCount++;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Hand message to libmosquitto
+ * ----------------------------------------------------------------------------------- */
+static bool publish( const mqttMessage_t *message ) {
+    int err = mosquitto_publish(mosq, NULL, message->topic, message->payloadlen, message->payload, 0, message->retain);
+    if ( err != MOSQ_ERR_SUCCESS) {
+        writeLog(LOG_ERR, "Error: mosquitto_publish failed [%s]", mosquitto_strerror(err));
+        return false;
+    }
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Send messages kept while the broker was unreachable, in one go
+ * ----------------------------------------------------------------------------------- */
+static void drainPending( void ) {
+    int sent = 0;
+    while ( pendingCount && publish(&pending[pendingFirst]) ) {
+        pendingFirst = (pendingFirst+1) % MQTT_PENDING_LEN;
+        pendingCount--;
+        sent++;
+    }
+    if ( sent || pendingDropped ) {
+        writeLog(LOG_NOTICE, "Sent %d buffered MQTT messages, %lu lost", sent, pendingDropped);
+        pendingDropped = 0;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Pass queued messages to libmosquitto, or keep them while not connected. Messages
+ * kept earlier go first, as long as some are left new ones are kept behind them.
+ * ----------------------------------------------------------------------------------- */
+static void sendQueued( void ) {
+    mqttMessage_t *slot;
+    if ( connected && pendingCount ) {
+        drainPending();
+    }
+    while ( (slot = spscReadSlot(&outbound)) ) {
+        if ( !connected || pendingCount || !publish(slot) ) {
+            keepPending(slot);
+        }
+        spscRelease(&outbound);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Plan next connect attempt: exponential backoff, randomized to the upper half of
+ * the delay so a restarted broker is not hit by all clients at once
  * ----------------------------------------------------------------------------------- */
-void dispatchMessage(struct mosquitto *mos, void *userData, const struct mosquitto_message *message) {
-    // identify callback functiion by matching topic
-    int idx = 0;
-    while (subscriptionList[idx].topic) {
-        if(!strcmp(message->topic, subscriptionList[idx].topic)) {
-            (subscriptionList[idx].handler)(message->payload,
-                                            message->payloadlen,
-                                            message->topic,
-                                            subscriptionList[idx].user_data);
+static void scheduleReconnect( void ) {
+    retryDelay = retryDelay ? retryDelay*2 : MQTT_RETRY_MIN*1000;
+    if ( retryDelay > MQTT_RETRY_MAX*1000 ) {
+        retryDelay = MQTT_RETRY_MAX*1000;
+    }
+    retryAt = nowMs() + retryDelay/2 + rand_r(&jitterSeed) % (retryDelay/2 + 1);
+    writeLog(LOG_DEBUG, "Reconnecting to MQTT broker in %d ms", (int)(retryAt - nowMs()));
+}
+
+static void connectionLost( void ) {
+    if ( connected ) {
+        writeLog(LOG_NOTICE, "Lost connection to MQTT broker");
+        connected = false;
+    }
+    if ( !retryAt ) {
+        scheduleReconnect();
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Broker accepted connection: subscribe again and send what has piled up
+ * ----------------------------------------------------------------------------------- */
+static void onConnect( struct mosquitto *mos, void *userData, int result ) {
+    if ( result ) {
+        writeLog(LOG_ERR, "Error: MQTT broker refused connection [%d]", result);
+        connectionLost();
+        return;
+    }
+    writeLog(LOG_NOTICE, "Connected to MQTT broker");
+    connected  = true;
+    retryDelay = 0;
+    retryAt    = 0;
+
+    for ( int idx=0; subscriptionList[idx].topic; idx++ ) {
+        mosquitto_subscribe( mosq, NULL, subscriptionList[idx].topic, 0);
+    }
+    drainPending();                              // keep order: older messages first
+    sendQueued();
+}
+
+static void onDisconnect( struct mosquitto *mos, void *userData, int result ) {
+    connectionLost();
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Network thread: wait for the broker socket or for outbound messages
+ * ----------------------------------------------------------------------------------- */
+static void *networkLoop( void *arg ) {
+    jitterSeed = (unsigned int)(nowMs() ^ getpid());
+
+    while ( atomic_load(&running) ) {
+        int timeout = 1000;
+
+        // time for another connect attempt?
+        if ( !connected && retryAt ) {
+            uint64_t now = nowMs();
+            if ( now >= retryAt ) {
+                retryAt = 0;
+                int err = mosquitto_reconnect(mosq);
+                if ( err != MOSQ_ERR_SUCCESS ) {
+                    writeLog(LOG_DEBUG, "MQTT reconnect failed [%s]", mosquitto_strerror(err));
+                    scheduleReconnect();
+                }
+            } else if ( retryAt - now < (uint64_t)timeout ) {
+                timeout = (int)(retryAt - now);
+            }
+        }
+
+        struct pollfd fds[2] = {
+            { mosquitto_socket(mosq), POLLIN, 0 },  // -1 while not connected, ignored by poll
+            { wakeupFd,               POLLIN, 0 },
+        };
+
+        sendQueued();
+        if ( mosquitto_want_write(mosq) ) {
+            fds[0].events |= POLLOUT;
+        }
+        if ( poll(fds, 2, timeout) < 0 && errno != EINTR ) {
+            writeLog(LOG_ERR, "Error: poll failed [%s]", strerror(errno));
             break;
         }
-        idx++;
+        if ( fds[1].revents & POLLIN ) {
+            uint64_t count;
+            if ( read(wakeupFd, &count, sizeof(count)) < 0 ) {
+                // nothing to do, eventfd is reset anyway
+            }
+        }
+        if ( fds[0].revents & (POLLIN|POLLHUP|POLLERR) ) {
+            if ( mosquitto_loop_read(mosq, 1) != MOSQ_ERR_SUCCESS ) {
+                connectionLost();
+            }
+        }
+        sendQueued();
+        if ( mosquitto_want_write(mosq) ) {
+            if ( mosquitto_loop_write(mosq, 1) != MOSQ_ERR_SUCCESS ) {
+                connectionLost();
+            }
+        }
+        if ( mosquitto_loop_misc(mosq) != MOSQ_ERR_SUCCESS && !retryAt ) {
+            connectionLost();                    // keepalive timed out
+        }
+    }
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Dispatch messages received by the network thread, call from the control loop.
+ * Returns number of messages handled.
+ * ----------------------------------------------------------------------------------- */
+int mqttProcessIncoming( void ) {
+    mqttMessage_t *slot;
+    int            handled = 0;
+    unsigned long  dropped = atomic_exchange(&droppedIncoming, 0);
+
+    if ( dropped ) {
+        writeLog(LOG_ERR, "Error: dropped %lu incoming MQTT messages", dropped);
+    }
+    if ( !mosq ) {
+        return 0;
+    }
+    while ( (slot = spscReadSlot(&inbound)) ) {
+        traceMessage(slot->topic, slot->payload, slot->payloadlen);
+        mqttDispatch(slot->topic, slot->payload, slot->payloadlen);
+        spscRelease(&inbound);
+        handled++;
+    }
+    return handled;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Run handler of the subscription matching topic, false if there is none
+ * ----------------------------------------------------------------------------------- */
+bool mqttDispatch( char *topic, char *payload, int payloadlen ) {
+    // identify callback function by walking the topic tree
+    mqttIncoming_t *subscription = topicTree ? matchTopic(topicTree, topic) : NULL;
+    if ( subscription ) {
+        (subscription->handler)(payload, payloadlen, topic, subscription->user_data);
     }
+    return subscription != NULL;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Compile topic tree of subscriptions, done by mqttInit. Without a broker messages
+ * can be fed in with mqttDispatch.
+ * ----------------------------------------------------------------------------------- */
+bool mqttSetHandlers( mqttIncoming_t *subscriptions ) {
+    bool success = true;
+
+    freeTopicTree(topicTree);
+    subscriptionList = subscriptions;
+    topicTree = calloc(1, sizeof(topicNode_t));
+    if ( !topicTree ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        return false;
+    }
+    for ( int idx=0; subscriptionList[idx].topic && success; idx++ ) {
+        success = addSubscription(&subscriptionList[idx]);
+    }
+    return success;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Function to call when messages are waiting, called on the network thread
+ * ----------------------------------------------------------------------------------- */
+void mqttSetNotify( void (*callback)(void) ) {
+    notify = callback;
 }
 
 /* ----------------------------------------------------------------------------------- *
@@ -71,34 +477,47 @@ bool mqttInit( const char* broker, int port, int keepalive, mqttIncoming_t *subs
     bool success = true;
     int err;
     
+    if ( !spscInit(&inbound, MQTT_QUEUE_LEN, sizeof(mqttMessage_t)) ||
+         !spscInit(&outbound, MQTT_QUEUE_LEN, sizeof(mqttMessage_t)) ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        return false;
+    }
+    wakeupFd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if ( wakeupFd < 0 ) {
+        writeLog(LOG_ERR, "Error: eventfd failed [%s]", strerror(errno));
+        return false;
+    }
+
     mosquitto_lib_init();
     mosq = mosquitto_new(NULL, true, NULL);
-    if(mosq){
-        err = mosquitto_connect(mosq, broker, port, keepalive);
-        if( err != MOSQ_ERR_SUCCESS ) {
-            writeLog(LOG_ERR, "Error: mosquitto_connect [%s]\n", mosquitto_strerror(err));
-            success = false;
-        }
-    } else {
-        writeLog(LOG_ERR, "Error: Out of memory.\n");
-        success = false;
+    if ( !mosq ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        return false;
     }
     
-    err = mosquitto_loop_start(mosq);
+    mosquitto_log_callback_set(mosq, &mqttLog);
+    mosquitto_message_callback_set(mosq, &receiveMessage);
+    mosquitto_connect_callback_set(mosq, &onConnect);
+    mosquitto_disconnect_callback_set(mosq, &onDisconnect);
+
+    // compile topic tree before the first message can arrive
+    mqttSetHandlers(subscriptions);
+
+    // topics are subscribed to in onConnect, after each (re)connect
+    err = mosquitto_connect(mosq, broker, port, keepalive);
     if( err != MOSQ_ERR_SUCCESS ) {
-        writeLog(LOG_ERR, "Error: mosquitto_connect [%s]\n", mosquitto_strerror(err));
+        writeLog(LOG_ERR, "Error: mosquitto_connect [%s], will retry", mosquitto_strerror(err));
+        scheduleReconnect();
+        success = false;
+    }
+
+    // from now on only the network thread uses mosq
+    atomic_store(&running, true);
+    err = pthread_create(&networkThread, NULL, &networkLoop, NULL);
+    if ( err ) {
+        writeLog(LOG_ERR, "Error: can't start MQTT thread [%s]", strerror(err));
+        atomic_store(&running, false);
         success = false;
-    } else {
-        mosquitto_log_callback_set(mosq, &mqttLog);
-
-        mosquitto_message_callback_set(mosq, &dispatchMessage);
-        subscriptionList = subscriptions;
-        int idx = 0;
-        while (subscriptionList[idx].topic) {
-            // writeLog(LOG_INFO, "Supscribe to MQTT topic: %s", subscriptionList[idx].topic);
-            mosquitto_subscribe( mosq, NULL, subscriptionList[idx].topic, 0);
-            idx++;
-        }
     }
     return success;
 }
@@ -107,28 +526,53 @@ bool mqttInit( const char* broker, int port, int keepalive, mqttIncoming_t *subs
  * End MQTT broker connection
  * ----------------------------------------------------------------------------------- */
 void mqttEnd( void ) {
-    mosquitto_loop_stop(mosq, true);
+    if ( atomic_exchange(&running, false) ) {
+        uint64_t one = 1;
+        if ( write(wakeupFd, &one, sizeof(one)) < 0 ) {
+            writeLog(LOG_ERR, "Error: can't wake up MQTT thread [%s]", strerror(errno));
+        }
+        pthread_join(networkThread, NULL);
+    }
     mosquitto_destroy(mosq);
     mosquitto_lib_cleanup();
     mosq = NULL;
+    freeTopicTree(topicTree);
+    topicTree = NULL;
+    close(wakeupFd);
+    wakeupFd = -1;
+    spscFree(&inbound);
+    spscFree(&outbound);
 }
 
 /* ----------------------------------------------------------------------------------- *
- * Publish MQTT message
+ * Publish MQTT message: queue it for the network thread, never blocks
  * ----------------------------------------------------------------------------------- */
-bool mqttPublish ( const char *topic, const char *message ) {
-    bool success = true;
-    int  err;
+bool mqttPublish ( const char *topic, const char *message, bool retain ) {
+    mqttMessage_t *slot;
+    size_t         topicLen = strlen(topic);
+    size_t         len      = strlen(message);
+    uint64_t       one      = 1;
     
-    if ( mosq ) {
-        err = mosquitto_publish( mosq, NULL, topic, strlen(message), message, 0, false);
-        if ( err != MOSQ_ERR_SUCCESS) {
-            writeLog(LOG_ERR, "Error: mosquitto_publish failed [%s]\n", mosquitto_strerror(err));
-            success = false;
-        }
-    } else {
-        writeLog(LOG_ERR, "Error: mosq == NULL, Init failed?\n");
-        success = false;
+    if ( !mosq ) {
+        writeLog(LOG_ERR, "Error: mosq == NULL, Init failed?");
+        return false;
     }
-    return success;
+    if ( topicLen >= MQTT_TOPIC_LEN || len >= MQTT_PAYLOAD_LEN ) {
+        writeLog(LOG_ERR, "Error: MQTT message to %s too long", topic);
+        return false;
+    }
+    if ( !(slot = spscWriteSlot(&outbound)) ) {
+        writeLog(LOG_ERR, "Error: MQTT send queue full, dropping message to %s", topic);
+        return false;
+    }
+    memcpy(slot->topic, topic, topicLen+1);
+    memcpy(slot->payload, message, len+1);
+    slot->payloadlen = (int)len;
+    slot->retain     = retain;
+    spscCommit(&outbound);
+
+    if ( write(wakeupFd, &one, sizeof(one)) < 0 ) {
+        writeLog(LOG_ERR, "Error: can't wake up MQTT thread [%s]", strerror(errno));
+    }
+    return true;
 }
@@ -18,12 +18,27 @@
 #ifndef mqttGateway_h
 #define mqttGateway_h
 #include <stdio.h>
+#include <stdbool.h>
 
 /* ----------------------------------------------------------------------------------- *
  * Define to turn on MQTT debug messages
  * ----------------------------------------------------------------------------------- */
 //#define MQTT_DEBUG
 
+/* ----------------------------------------------------------------------------------- *
+ * Limits of the queues between network thread and control loop
+ * ----------------------------------------------------------------------------------- */
+#define MQTT_QUEUE_LEN     64    // messages per direction, power of two
+#define MQTT_TOPIC_LEN    128    // longest topic + 1
+#define MQTT_PAYLOAD_LEN  256    // longest payload + 1
+#define MQTT_PENDING_LEN   32    // topics kept while the broker is unreachable
+
+/* ----------------------------------------------------------------------------------- *
+ * Reconnect backoff, doubled after each failed attempt
+ * ----------------------------------------------------------------------------------- */
+#define MQTT_RETRY_MIN      1    // seconds
+#define MQTT_RETRY_MAX     60    // seconds
+
 /* ----------------------------------------------------------------------------------- *
  * handler for incoming MQTT messages
  * ----------------------------------------------------------------------------------- */
@@ -32,7 +47,8 @@
  *   void switchValveCB(char *payload, int payloadlen, char *topic, void *user_data);
  */
 typedef struct mqttIncoming_t {
-    const char* topic;                           // MQTT topic to subscribe to
+    const char* topic;                           // MQTT topic to subscribe to, '+' and '#'
+                                                 // wildcards are supported
     void  (*handler)(char*, int, char*, void*);  // callback function
     void  *user_data;                            // user defined argument to callback
 } mqttIncoming_t;
@@ -44,6 +60,10 @@ typedef struct mqttIncoming_t {
  * ----------------------------------------------------------------------------------- */
 bool mqttInit(const char* broker, int port, int keepalive, mqttIncoming_t *subscriptions);
 void mqttEnd(void );
-bool mqttPublish (const char *topic, const char *message);
+bool mqttPublish (const char *topic, const char *message, bool retain);  // queue message
+int  mqttProcessIncoming(void);                      // run handlers for received messages
+void mqttSetNotify(void (*callback)(void));          // called when messages are waiting
+bool mqttSetHandlers(mqttIncoming_t *subscriptions); // compile topic tree, done by mqttInit
+bool mqttDispatch(char *topic, char *payload, int payloadlen);  // run handler for message
 
 #endif /* mqttGateway_h */
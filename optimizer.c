@@ -0,0 +1,183 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "optimizer.h"
+#include "packer.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * The packer places runs in the order given, so the order of the VALVE lines decides
+ * how long a sequence takes. The optimizer tries a few orders and keeps the one that
+ * ends first: the order given, longest runs first, and list scheduling (always the
+ * run that can start earliest, longer runs first). Runs don't move across a PAUSE.
+ * Each try costs O(n^2) for n runs, a few hundred runs take milliseconds.
+ * ----------------------------------------------------------------------------------- */
+
+/* ----------------------------------------------------------------------------------- *
+ * Offset the last valve closes at if runs are placed in the order given
+ * ----------------------------------------------------------------------------------- */
+static int makespan( packer_t *packer, const run_t *runs, int numRuns ) {
+    sequence_t on, off;
+    packerReset(packer);
+    for ( int run=0; run<numRuns; run++ ) {
+        packerPlace(packer, &runs[run], &on, &off);
+    }
+    return numRuns > 0 ? packer->lastEnd : 0;
+}
+
+// end of segment starting at run <first>, the next PAUSE starts a new one
+static int segmentEnd( const run_t *runs, int numRuns, int first ) {
+    int last = first+1;
+    while ( last < numRuns && runs[last].pause == 0 ) last++;
+    return last;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Longest runs first, the PAUSE stays in front of the segment
+ * ----------------------------------------------------------------------------------- */
+static void longestFirst( const run_t *runs, int numRuns, run_t *order ) {
+    memcpy(order, runs, numRuns * sizeof(run_t));
+    for ( int first=0; first<numRuns; first=segmentEnd(runs, numRuns, first) ) {
+        int last  = segmentEnd(runs, numRuns, first);
+        int pause = order[first].pause;
+
+        order[first].pause = 0;
+        for ( int idx=first+1; idx<last; idx++ ) {         // stable insertion sort
+            run_t run = order[idx];
+            int   pos = idx;
+            while ( pos > first && order[pos-1].duration < run.duration ) {
+                order[pos] = order[pos-1];
+                pos--;
+            }
+            order[pos] = run;
+        }
+        order[first].pause = pause;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * List scheduling: next is the run that can start earliest, the longer one if
+ * several can start at the same time
+ * ----------------------------------------------------------------------------------- */
+static bool earliestFirst( packer_t *packer, const run_t *runs, int numRuns, run_t *order ) {
+    bool      *placed = calloc(numRuns, sizeof(bool));
+    sequence_t on, off;
+
+    if ( !placed ) {
+        return false;
+    }
+    packerReset(packer);
+    for ( int first=0; first<numRuns; first=segmentEnd(runs, numRuns, first) ) {
+        int last  = segmentEnd(runs, numRuns, first);
+        int pause = runs[first].pause;
+
+        for ( int pos=first; pos<last; pos++ ) {
+            int   best = -1, bestStart = 0;
+            run_t next;
+
+            for ( int idx=first; idx<last; idx++ ) {
+                if ( placed[idx] ) {
+                    continue;
+                }
+                run_t candidate = runs[idx];
+                candidate.pause = pos == first ? pause : 0;
+                int start = packerEarliest(packer, &candidate);
+                if ( best < 0 || start < bestStart
+                     || (start == bestStart && candidate.duration > next.duration) ) {
+                    best      = idx;
+                    bestStart = start;
+                    next      = candidate;
+                }
+            }
+            placed[best] = true;
+            order[pos]   = next;
+            packerPlace(packer, &next, &on, &off);
+        }
+    }
+    free(placed);
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Optimize a single program, keeps the order given unless another one is shorter
+ * ----------------------------------------------------------------------------------- */
+static bool optimizeProgram( const config_t *cfg, program_t *program ) {
+    int     numRuns = program->numRuns;
+    run_t  *best    = malloc(numRuns * sizeof(run_t));
+    run_t  *order   = malloc(numRuns * sizeof(run_t));
+    packer_t packer;
+
+    if ( !best || !order || !packerInit(&packer, cfg, numRuns) ) {
+        free(best);
+        free(order);
+        return false;
+    }
+
+    int before   = makespan(&packer, program->runs, numRuns);
+    int shortest = before;
+    memcpy(best, program->runs, numRuns * sizeof(run_t));
+
+    longestFirst(program->runs, numRuns, order);
+    int length = makespan(&packer, order, numRuns);
+    if ( length < shortest ) {
+        shortest = length;
+        memcpy(best, order, numRuns * sizeof(run_t));
+    }
+    if ( earliestFirst(&packer, program->runs, numRuns, order) ) {
+        length = makespan(&packer, order, numRuns);
+        if ( length < shortest ) {
+            shortest = length;
+            memcpy(best, order, numRuns * sizeof(run_t));
+        }
+    }
+
+    memcpy(program->runs, best, numRuns * sizeof(run_t));
+    printf("# SEQUENCE %d: %d min before, %d min after\n",
+           program->id, before/TIME_SCALE, shortest/TIME_SCALE);
+
+    packerFree(&packer);
+    free(best);
+    free(order);
+    return packProgram(cfg, program);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Optimize all programs of config, prints how long each of them takes
+ * ----------------------------------------------------------------------------------- */
+bool optimizeConfig( config_t *cfg ) {
+    struct timespec start, end;
+    bool   retval = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    printf("# ----------------------------------------------------------------------------------- #\n");
+    for ( int idx=0; idx<cfg->numPrograms && retval; idx++ ) {
+        retval = optimizeProgram(cfg, &cfg->programs[idx]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    long usec = (end.tv_sec - start.tv_sec)*1000000L + (end.tv_nsec - start.tv_nsec)/1000;
+    printf("# %d sequences optimized in %ld us\n", cfg->numPrograms, usec);
+    if ( !retval ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+    }
+    return retval;
+}
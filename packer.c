@@ -0,0 +1,215 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "packer.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Set up packer for sequences of up to maxRuns runs
+ * ----------------------------------------------------------------------------------- */
+bool packerInit( packer_t *packer, const config_t *cfg, int maxRuns ) {
+    unsigned size = 16;
+    while ( size < 4u*maxRuns ) size <<= 1;      // two offsets per run, half full at most
+
+    memset(packer, 0, sizeof(packer_t));
+    packer->cfg        = cfg;
+    packer->flowBudget = cfg->flowBudget;
+    packer->maxValves  = cfg->maxValves > 0 ? cfg->maxValves : cfg->flowBudget > 0 ? INT_MAX : 1;
+    packer->open       = malloc((maxRuns+1) * sizeof(openValve_t));
+    packer->zoneFree   = malloc((cfg->numZones+1) * sizeof(int));
+    packer->taken      = malloc(size * sizeof(int));
+    packer->takenMask  = size-1;
+    if ( !packer->open || !packer->zoneFree || !packer->taken ) {
+        packerFree(packer);
+        return false;
+    }
+    packerReset(packer);
+    return true;
+}
+
+void packerReset( packer_t *packer ) {
+    packer->numOpen   = 0;
+    packer->lastStart = 0;
+    packer->lastEnd   = -1;                      // a leading PAUSE ends at pause-1 like before
+    memset(packer->zoneFree, 0, packer->cfg->numZones * sizeof(int));
+    memset(packer->taken, 0, (packer->takenMask+1) * sizeof(int));
+}
+
+void packerFree( packer_t *packer ) {
+    free(packer->open);
+    free(packer->zoneFree);
+    free(packer->taken);
+    packer->open     = NULL;
+    packer->zoneFree = NULL;
+    packer->taken    = NULL;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Hash set of offsets in use
+ * ----------------------------------------------------------------------------------- */
+static int *takenSlot( const packer_t *packer, int offset ) {
+    unsigned hash = ((unsigned)offset * 2654435761u) & packer->takenMask;
+    while ( packer->taken[hash] && packer->taken[hash] != offset+1 ) {
+        hash = (hash+1) & packer->takenMask;
+    }
+    return &packer->taken[hash];
+}
+
+static bool isTaken( const packer_t *packer, int offset ) {
+    return *takenSlot(packer, offset) != 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Flow a zone takes, zones without rating take all there is
+ * ----------------------------------------------------------------------------------- */
+static int zoneFlow( const packer_t *packer, int valve ) {
+    int flow = packer->cfg->zones[valve].flow;
+    return flow > 0 && flow <= packer->flowBudget ? flow : packer->flowBudget;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Earliest offset run can start at, given the runs placed so far
+ * ----------------------------------------------------------------------------------- */
+int packerEarliest( const packer_t *packer, const run_t *run ) {
+    int flow     = zoneFlow(packer, run->valve);
+    int duration = run->duration * TIME_SCALE;
+    int start;
+
+    if ( run->pause > 0 ) {
+        // all valves closed, then the pause
+        start = packer->lastEnd + run->pause * TIME_SCALE;
+    } else {
+        start = packer->lastStart;
+        for ( ;; ) {
+            int numOpen = 0, used = 0, firstEnd = INT_MAX;
+            for ( int idx=0; idx<packer->numOpen; idx++ ) {
+                const openValve_t *open = &packer->open[idx];
+                if ( open->end >= start ) {
+                    numOpen++;
+                    used += open->flow;
+                    if ( open->end < firstEnd ) firstEnd = open->end;
+                }
+            }
+            if ( numOpen < packer->maxValves && (packer->flowBudget <= 0 || used + flow <= packer->flowBudget) ) {
+                break;
+            }
+            start = firstEnd+1;                  // wait for the next valve to close
+        }
+    }
+    if ( start < packer->zoneFree[run->valve] ) {
+        start = packer->zoneFree[run->valve];
+    }
+    // no two steps at the same time, a few seconds later doesn't hurt
+    while ( isTaken(packer, start) || isTaken(packer, start+duration) ) {
+        start++;
+    }
+    return start;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Place run at the earliest offset possible, fills in its steps, returns the offset
+ * ----------------------------------------------------------------------------------- */
+int packerPlace( packer_t *packer, const run_t *run, sequence_t *on, sequence_t *off ) {
+    int start = packerEarliest(packer, run);
+    int end   = start + run->duration * TIME_SCALE;
+    int keep  = 0;
+
+    // forget valves closed by now
+    for ( int idx=0; idx<packer->numOpen; idx++ ) {
+        if ( packer->open[idx].end >= start ) {
+            packer->open[keep++] = packer->open[idx];
+        }
+    }
+    packer->numOpen = keep;
+    packer->open[packer->numOpen].end   = end;
+    packer->open[packer->numOpen].flow  = zoneFlow(packer, run->valve);
+    packer->open[packer->numOpen].valve = run->valve;
+    packer->numOpen++;
+
+    packer->lastStart = start;
+    if ( end > packer->lastEnd ) {
+        packer->lastEnd = end;
+    }
+    // the valve was closed at end, it may open again at end+1 at the earliest
+    packer->zoneFree[run->valve] = end + 1 + packer->cfg->zones[run->valve].soak * TIME_SCALE;
+    *takenSlot(packer, start) = start+1;
+    *takenSlot(packer, end)   = end+1;
+
+    on->offset  = start;
+    on->valve   = run->valve;
+    on->state   = true;
+    on->done    = false;
+    off->offset = end;
+    off->valve  = run->valve;
+    off->state  = false;
+    off->done   = false;
+    return start;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Lay out steps of program from its runs, in the order given
+ * ----------------------------------------------------------------------------------- */
+static int compareSteps( const void *a, const void *b ) {
+    const sequence_t *left = a, *right = b;
+    return left->offset < right->offset ? -1 : left->offset > right->offset;
+}
+
+// one valve at a time and no soak times: each run starts right after the previous one
+static bool isSerial( const config_t *cfg, const program_t *program ) {
+    bool serial = cfg->maxValves == 1 || (cfg->maxValves == 0 && cfg->flowBudget <= 0);
+    for ( int run=0; serial && run<program->numRuns; run++ ) {
+        serial = cfg->zones[program->runs[run].valve].soak == 0;
+    }
+    return serial;
+}
+
+bool packProgram( const config_t *cfg, program_t *program ) {
+    packer_t packer;
+
+    program->numSteps = 2*program->numRuns;
+    if ( isSerial(cfg, program) ) {
+        int end = -1;
+        for ( int run=0; run<program->numRuns; run++ ) {
+            const run_t *r   = &program->runs[run];
+            sequence_t  *on  = &program->steps[2*run];
+            sequence_t  *off = on+1;
+            on->offset  = end + (r->pause > 0 ? r->pause * TIME_SCALE : 1);
+            on->valve   = r->valve;
+            on->state   = true;
+            on->done    = false;
+            off->offset = end = on->offset + r->duration * TIME_SCALE;
+            off->valve  = r->valve;
+            off->state  = false;
+            off->done   = false;
+        }
+        return true;
+    }
+    if ( !packerInit(&packer, cfg, program->numRuns) ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        return false;
+    }
+    for ( int run=0; run<program->numRuns; run++ ) {
+        packerPlace(&packer, &program->runs[run], &program->steps[2*run], &program->steps[2*run+1]);
+    }
+    qsort(program->steps, program->numSteps, sizeof(sequence_t), &compareSteps);
+    packerFree(&packer);
+    return true;
+}
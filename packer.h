@@ -0,0 +1,65 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+#include "readConfig.h"
+
+#ifndef packer_h
+#define packer_h
+
+/* ----------------------------------------------------------------------------------- *
+ * Lays out the VALVE lines of a sequence on a time line. Runs are placed one after
+ * the other, each at the earliest offset where
+ *
+ *   - fewer than MAXVALVES valves are open
+ *   - the flows of the open valves and its own fit FLOWBUDGET
+ *   - its zone has been closed for at least its SOAK time
+ *
+ * and not before the run placed last. A PAUSE waits for all valves to close. With
+ * neither MAXVALVES nor FLOWBUDGET one valve is open at a time. No two steps share
+ * an offset, so steps keep a strict order.
+ * ----------------------------------------------------------------------------------- */
+typedef struct openValve_t {
+    int end;                     // offset the valve closes at
+    int flow;
+    int valve;
+} openValve_t;
+
+typedef struct packer_t {
+    const config_t *cfg;
+    int             maxValves;   // effective limits
+    int             flowBudget;
+    openValve_t    *open;        // valves that may still be open
+    int             numOpen;
+    int             lastStart;   // offset of run placed last
+    int             lastEnd;     // offset the last valve closes at
+    int            *zoneFree;    // per zone: offset it may open again
+    int            *taken;       // hash set of offsets in use, stored as offset+1
+    unsigned        takenMask;
+} packer_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+bool packerInit(packer_t *packer, const config_t *cfg, int maxRuns);  // room for maxRuns
+void packerReset(packer_t *packer);                      // start an empty time line
+void packerFree(packer_t *packer);
+int  packerEarliest(const packer_t *packer, const run_t *run);        // offset run would start at
+int  packerPlace(packer_t *packer, const run_t *run, sequence_t *on, sequence_t *off);
+bool packProgram(const config_t *cfg, program_t *program);  // lay out steps from runs
+
+#endif /* packer_h */
@@ -15,14 +15,20 @@
 /*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
 /* *********************************************************************************** */
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 
 #include "logging.h"
 #include "persistState.h"
+#include "clockSource.h"
 
 /* ----------------------------------------------------------------------------------- *
  * Some globals we can't do without
@@ -30,35 +36,243 @@
 char *stateDir      = STATE_DIR;              // directory for state files
 
 /* ----------------------------------------------------------------------------------- *
- * Safe state by creating/removing a file in the state file directory
+ * All state is kept in a single file, which is an image of this structure. Entries
+ * are placed by a hash of their name (linear probing), so lookups are O(1).
  * ----------------------------------------------------------------------------------- */
-void saveState (const char *name, bool state) {
-    if (readState(name) != state) {
-        char *fname = malloc( sizeof(char) * ( strlen(stateDir)+strlen(name) + 2 ) );
-        sprintf( fname, "%s/%s", stateDir, name );
-        if (state) {
-            int fd = open(fname, O_CREAT | O_WRONLY, S_IRWXU );
-            close ( fd );
+#define STATE_MAGIC    0x54534359            // "YCST"
+#define STATE_VERSION  1
+
+typedef struct stateEntry_t {
+    char    name[STATE_NAME_LEN];            // empty: slot unused
+    int32_t type;                            // STATE_BOOL, STATE_INT, ...
+    int32_t reserved;
+    int64_t value;
+} stateEntry_t;
+
+typedef struct stateFile_t {
+    uint32_t     magic;
+    uint32_t     version;
+    uint32_t     checksum;                   // FNV-1a over everything behind it
+    uint32_t     reserved;
+    uint64_t     generation;                 // incremented with each commit
+    stateEntry_t entry[STATE_SLOTS];
+} stateFile_t;
+
+static stateFile_t state;                    // in memory copy, the file is written from it
+static bool        stateOpen  = false;
+static bool        dirty      = false;       // changes not yet committed
+static time_t      dirtySince = 0;           // clockMono() of first change
+static time_t      retryDelay = 0;           // extra wait after failed commits
+
+/* ----------------------------------------------------------------------------------- *
+ * Checksum of file contents
+ * ----------------------------------------------------------------------------------- */
+static uint32_t checksum( const stateFile_t *file ) {
+    const unsigned char *data = (const unsigned char*)&file->generation;
+    size_t   len  = sizeof(stateFile_t) - offsetof(stateFile_t, generation);
+    uint32_t hash = 2166136261u;
+    while ( len-- ) {
+        hash = (hash ^ *data++) * 16777619u;
+    }
+    return hash;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Slot of named entry, or of the free slot it would go to. -1 if table is full.
+ * ----------------------------------------------------------------------------------- */
+static int findSlot( const char *name ) {
+    uint32_t hash = 2166136261u;
+    for ( const char *c=name; *c; c++ ) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    for ( int probe=0; probe<STATE_SLOTS; probe++ ) {
+        int slot = (hash + probe) % STATE_SLOTS;
+        if ( !state.entry[slot].name[0] || !strncmp(state.entry[slot].name, name, STATE_NAME_LEN) ) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Name of a file in the state directory
+ * ----------------------------------------------------------------------------------- */
+static void statePath( char *path, size_t size, const char *name ) {
+    snprintf(path, size, "%s/%s", stateDir, name);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Write state to temporary file and rename it, so there always is a complete file
+ * ----------------------------------------------------------------------------------- */
+bool commitState( void ) {
+    char path[256], temp[256];
+    bool success = false;
+
+    if ( !dirty ) {
+        return true;
+    }
+    statePath(path, sizeof(path), STATE_FILE);
+    statePath(temp, sizeof(temp), STATE_FILE ".new");
+
+    state.generation++;
+    state.checksum = checksum(&state);
+
+    int fd = open(temp, O_CREAT|O_TRUNC|O_WRONLY, S_IRUSR|S_IWUSR);
+    if ( fd < 0 ) {
+        writeLog(LOG_ERR, "Error: Can't create %s [%s]", temp, strerror(errno));
+    } else {
+        if ( write(fd, &state, sizeof(state)) != sizeof(state) || fsync(fd) ) {
+            writeLog(LOG_ERR, "Error: Can't write %s [%s]", temp, strerror(errno));
+            close(fd);
+        } else if ( close(fd) || rename(temp, path) ) {
+            writeLog(LOG_ERR, "Error: Can't replace %s [%s]", path, strerror(errno));
         } else {
-            unlink(fname);
+            // make the rename itself durable
+            int dir = open(stateDir, O_RDONLY|O_DIRECTORY);
+            if ( dir >= 0 ) {
+                fsync(dir);
+                close(dir);
+            }
+            success = true;
         }
-        free(fname);
     }
-    writeLog(LOG_DEBUG, "writeState( %s, %s )", name, state ? "TRUE" : "FALSE" );
+    dirty = !success;
+    writeLog(LOG_DEBUG, "commitState( generation %llu ) -> %s",
+             (unsigned long long)state.generation, success ? "OK" : "FAILED");
+    return success;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Commit changes once they are older than STATE_COMMIT_DELAY, so a burst of changes
+ * ends up in one write. Call regulary with clockMono(). After a failed commit the
+ * next attempt waits twice as long, up to STATE_RETRY_MAX.
+ * ----------------------------------------------------------------------------------- */
+void syncState( time_t now ) {
+    if ( dirty && now - dirtySince >= STATE_COMMIT_DELAY + retryDelay ) {
+        if ( commitState() ) {
+            retryDelay = 0;
+        } else {
+            dirtySince = now;
+            retryDelay = retryDelay ? retryDelay*2 : STATE_COMMIT_DELAY;
+            if ( retryDelay > STATE_RETRY_MAX ) {
+                retryDelay = STATE_RETRY_MAX;
+            }
+        }
+    }
+}
+
+static void commitAtExit( void ) {
+    commitState();
 }
 
 /* ----------------------------------------------------------------------------------- *
- * Read state by checking if a file of the given name exists
+ * Take over state of an older version that used one file per flag
  * ----------------------------------------------------------------------------------- */
-bool readState (const char *name) {
-    bool state = false;
-    char *fname = malloc(sizeof(char) * ( strlen(stateDir)+strlen(name) + 2 ) );
+static void migrateFlags( void ) {
+    static const char *flags[] = { "sequence", "automatic", NULL };
+    char path[256];
     struct stat buf;
-    sprintf( fname, "%s/%s", stateDir, name );
-    if (!stat(fname, &buf)) {
-        state = true;
+
+    for ( int idx=0; flags[idx]; idx++ ) {
+        statePath(path, sizeof(path), flags[idx]);
+        if ( !stat(path, &buf) ) {
+            writeLog(LOG_NOTICE, "Migrating state flag %s", path);
+            saveState(flags[idx], true);
+        }
+    }
+    if ( dirty && commitState() ) {
+        for ( int idx=0; flags[idx]; idx++ ) {
+            statePath(path, sizeof(path), flags[idx]);
+            unlink(path);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Map state file and copy it to memory, done on first access
+ * ----------------------------------------------------------------------------------- */
+static void openState( void ) {
+    char path[256];
+    bool valid = false;
+
+    stateOpen = true;
+    memset(&state, 0, sizeof(state));
+    state.magic   = STATE_MAGIC;
+    state.version = STATE_VERSION;
+
+    statePath(path, sizeof(path), STATE_FILE);
+    int fd = open(path, O_RDONLY);
+    if ( fd >= 0 ) {
+        struct stat buf;
+        if ( !fstat(fd, &buf) && buf.st_size == sizeof(stateFile_t) ) {
+            stateFile_t *file = mmap(NULL, sizeof(stateFile_t), PROT_READ, MAP_PRIVATE, fd, 0);
+            if ( file != MAP_FAILED ) {
+                if ( file->magic == STATE_MAGIC && file->version == STATE_VERSION &&
+                     file->checksum == checksum(file) ) {
+                    memcpy(&state, file, sizeof(state));
+                    valid = true;
+                }
+                munmap(file, sizeof(stateFile_t));
+            }
+        }
+        close(fd);
+        if ( !valid ) {
+            writeLog(LOG_ERR, "Error: %s is damaged or of a different version, ignored", path);
+        }
+    }
+
+    atexit(&commitAtExit);
+    if ( !valid ) {
+        migrateFlags();
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Typed access
+ * ----------------------------------------------------------------------------------- */
+static void storeValue( const char *name, int type, long value ) {
+    if ( !stateOpen ) {
+        openState();
     }
-    free (fname);
-    writeLog(LOG_DEBUG, "readState( %s ) -> %s", name, state ? "TRUE" : "FALSE" );
-    return state;
+    int slot = findSlot(name);
+    if ( slot < 0 ) {
+        writeLog(LOG_ERR, "Error: No room to save state %s", name);
+        return;
+    }
+    stateEntry_t *entry = &state.entry[slot];
+    if ( !entry->name[0] || entry->type != type || entry->value != value ) {
+        strncpy(entry->name, name, STATE_NAME_LEN-1);
+        entry->type  = type;
+        entry->value = value;
+        if ( !dirty ) {
+            dirtySince = clockMono();
+            dirty      = true;
+        }
+    }
+    writeLog(LOG_DEBUG, "saveState( %s, %ld )", name, value);
+}
+
+void saveStateInt( const char *name, long value ) {
+    storeValue(name, STATE_INT, value);
+}
+
+long readStateInt( const char *name, long defaultValue ) {
+    if ( !stateOpen ) {
+        openState();
+    }
+    int  slot  = findSlot(name);
+    long value = (slot >= 0 && state.entry[slot].name[0]) ? (long)state.entry[slot].value : defaultValue;
+    writeLog(LOG_DEBUG, "readState( %s ) -> %ld", name, value);
+    return value;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Boolean state, a missing entry reads as false
+ * ----------------------------------------------------------------------------------- */
+void saveState( const char *name, bool value ) {
+    storeValue(name, STATE_BOOL, value ? 1 : 0);
+}
+
+bool readState( const char *name ) {
+    return readStateInt(name, 0) != 0;
 }
@@ -15,6 +15,7 @@
 /*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
 /* *********************************************************************************** */
 #include <stdbool.h>
+#include <time.h>
 
 #ifndef persistState_h
 #define persistState_h
@@ -23,6 +24,17 @@
  * Default Settings
  * ----------------------------------------------------------------------------------- */
 #define STATE_DIR    "/var/lib/yardcontrol"            // store state files here
+#define STATE_FILE   "state"                           // name of state file in STATE_DIR
+#define STATE_SLOTS        32                          // max. number of entries
+#define STATE_NAME_LEN     24                          // longest name + 1
+#define STATE_COMMIT_DELAY  2                          // seconds to collect changes
+#define STATE_RETRY_MAX   300                          // longest wait after failed commits
+
+/* ----------------------------------------------------------------------------------- *
+ * Types of state entries
+ * ----------------------------------------------------------------------------------- */
+#define STATE_BOOL    0
+#define STATE_INT     1
 
 /* ----------------------------------------------------------------------------------- *
  * Some globals we can't do without
@@ -34,5 +46,9 @@ extern char *stateDir;                                // directory for state fil
  * ----------------------------------------------------------------------------------- */
 void saveState ( const char *name, bool value );      // safe state of boolean value
 bool readState ( const char *name );                  // read named state
+void saveStateInt ( const char *name, long value );   // safe integer value
+long readStateInt ( const char *name, long defaultValue );
+bool commitState ( void );                            // write changes to disk now
+void syncState ( time_t now );                        // write changes when due
 
 #endif /* persistState_h */
@@ -0,0 +1,118 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "publisher.h"
+#include "mqttGateway.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Payloads, the same for all buttons
+ * ----------------------------------------------------------------------------------- */
+static const char *payloadOn  = "{\"state\":\"ON\"}";
+static const char *payloadOff = "{\"state\":\"OFF\"}";
+
+/* ----------------------------------------------------------------------------------- *
+ * Publishing state of each button
+ * ----------------------------------------------------------------------------------- */
+typedef struct published_t {
+    char *topic;                 // topic to publish state to
+    int   lastState;             // state last sent, -1 if never sent
+    bool  queued;                // in dirty list
+    bool  force;                 // send even if state has not changed
+} published_t;
+
+static pushbutton_t *buttonList = NULL;       // buttons we publish
+static published_t  *published  = NULL;      // one entry per button
+static int          *dirty      = NULL;       // indices of queued buttons
+static int           numDirty   = 0;
+
+/* ----------------------------------------------------------------------------------- *
+ * Build topic strings for all buttons
+ * ----------------------------------------------------------------------------------- */
+bool publisherInit( pushbutton_t *buttons, int numButtons, const char *prefix ) {
+    buttonList = buttons;
+    published  = calloc(numButtons, sizeof(published_t));
+    dirty      = calloc(numButtons, sizeof(int));
+    if ( !published || !dirty ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        return false;
+    }
+
+    for ( int idx=0; idx<numButtons; idx++ ) {
+        size_t len = strlen(prefix) + strlen(buttons[idx].name) + 8;
+        published[idx].topic = malloc(len);
+        if ( !published[idx].topic ) {
+            writeLog(LOG_ERR, "Error: Out of memory.");
+            return false;
+        }
+        snprintf(published[idx].topic, len, "%s/Valve_%s", prefix, buttons[idx].name);
+        published[idx].lastState = -1;
+    }
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Add button to dirty list, a button is listed only once
+ * ----------------------------------------------------------------------------------- */
+static void queue( pushbutton_t *button, bool force ) {
+    if ( published ) {
+        int idx = (int)(button - buttonList);
+        if ( !published[idx].queued ) {
+            published[idx].queued = true;
+            dirty[numDirty++]     = idx;
+        }
+        published[idx].force |= force;
+    }
+}
+
+void publishStatus( pushbutton_t *button ) {
+    queue(button, false);
+}
+
+void republishStatus( pushbutton_t *button ) {
+    queue(button, true);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Send state of all buttons in the dirty list, as retained messages so clients
+ * connecting later get the current state from the broker. Buttons that couldn't be
+ * sent stay in the list for the next flush. Returns number of messages sent.
+ * ----------------------------------------------------------------------------------- */
+int publisherFlush( void ) {
+    int sent = 0, kept = 0;
+    for ( int entry=0; entry<numDirty; entry++ ) {
+        published_t *pub  = &published[dirty[entry]];
+        int          state = buttonList[dirty[entry]].state ? 1 : 0;
+
+        if ( pub->force || pub->lastState != state ) {
+            if ( !mqttPublish(pub->topic, state ? payloadOn : payloadOff, true) ) {
+                dirty[kept++] = dirty[entry];
+                continue;
+            }
+            pub->lastState = state;
+            sent++;
+        }
+        pub->queued = false;
+        pub->force  = false;
+    }
+    numDirty = kept;
+    return sent;
+}
@@ -15,33 +15,68 @@
 /*  You should have received a copy of the GNU General Public License                  */
 /*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
 /* *********************************************************************************** */
-#include <wiringPi.h>
 #include <stdio.h>
 
 #include "pushButton.h"
+#include "hardware.h"
+#include "debounce.h"
+#include "trace.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Debouncer for the button inputs of each IO extender
+ * ----------------------------------------------------------------------------------- */
+static debounce_t debouncer[HW_MAX_CHIPS] = {
+    [0 ... HW_MAX_CHIPS-1] = { .pressSamples = PRESS_SAMPLES, .releaseSamples = RELEASE_SAMPLES }
+};
+
+/* ----------------------------------------------------------------------------------- *
+ * Set number of stable samples needed to accept a press or a release
+ * ----------------------------------------------------------------------------------- */
+void setDebounce(int pressSamples, int releaseSamples) {
+    for ( int chip=0; chip<HW_MAX_CHIPS; chip++ ) {
+        debounceInit(&debouncer[chip], pressSamples, releaseSamples);
+    }
+}
 
 /* ----------------------------------------------------------------------------------- *
  * poll Buttons
  * ----------------------------------------------------------------------------------- */
-void pollButtons(pushbutton_t pushButtons[]) {
-    int btnIndex = 0;
-    while ( pushButtons[btnIndex].btnPin >= 0 ) {
-        readButton(&pushButtons[btnIndex], pushButtons);
-        btnIndex++;
+bool pollButtons(pushbutton_t pushButtons[], int numButtons) {
+    bool     changed = false;
+    bool     any     = false;
+    unsigned edges[HW_MAX_CHIPS];
+
+    // read all inputs of all chips at once, only look at buttons whose debounced level changed
+    hwSample();
+    for ( int chip=0; chip<hwNumChips(); chip++ ) {
+        edges[chip] = debounceUpdate(&debouncer[chip], hwChipSample(chip));
+        any |= edges[chip] != 0;
+    }
+
+    for ( int btnIndex=0; any && btnIndex<numButtons; btnIndex++ ) {
+        int pin = pushButtons[btnIndex].btnPin;
+        if ( pin >= 0 && (edges[hwPinChip(pin)] & hwPinMask(pin)) ) {
+            bool     oldState = pushButtons[btnIndex].state;
+            unsigned sample   = debouncer[hwPinChip(pin)].state;
+            traceButton(btnIndex, (sample & hwPinMask(pin)) ? HIGH : LOW);
+            if ( readButton(&pushButtons[btnIndex], pushButtons, numButtons, sample) != oldState ) {
+                changed = true;
+            }
+        }
    }
+   return changed;
 }
 
 /* ----------------------------------------------------------------------------------- *
  * Process radio groups of the given button
  * ----------------------------------------------------------------------------------- */
-void processRadioGroup(pushbutton_t *button, pushbutton_t *buttonList) {
+void processRadioGroup(pushbutton_t *button, pushbutton_t *buttonList, int numButtons) {
     // if a radio group has been defined clear state of all other buttons in this group
     if ( button->state && button->radioGroup > 0 ) {
-        int btnIndex = 0;
         // clear state of active members in radio group
-        while ( buttonList[btnIndex].btnPin >= 0 ) {
+        for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
             if ( buttonList[btnIndex].radioGroup == button->radioGroup   // same radio group
-                && buttonList[btnIndex].btnPin != button->btnPin         // not myself
+                && &buttonList[btnIndex] != button                       // not myself
                 && buttonList[btnIndex].state ) {                        // active
                 // clear state
                 buttonList[btnIndex].state = false;
@@ -50,7 +85,6 @@ void processRadioGroup(pushbutton_t *button, pushbutton_t *buttonList) {
                     (*buttonList[btnIndex].callback)(&buttonList[btnIndex]);
                 }
             }
-            btnIndex++;
         }
     }
 }
@@ -58,11 +92,11 @@ void processRadioGroup(pushbutton_t *button, pushbutton_t *buttonList) {
 /* ----------------------------------------------------------------------------------- *
  * Process push button
  * ----------------------------------------------------------------------------------- */
-bool readButton( pushbutton_t *button, pushbutton_t *buttonList) {
+bool readButton( pushbutton_t *button, pushbutton_t *buttonList, int numButtons, unsigned sample) {
     // respect locked state
     if ( !button->locked) {
-        // read the button pin
-        int newReading = digitalRead(button->btnPin);
+        // take reading of button pin from sample
+        int newReading = (sample & hwPinMask(button->btnPin)) ? HIGH : LOW;
         
         // if there has been a change
         if ( newReading != button->lastReading ) {
@@ -73,7 +107,7 @@ bool readButton( pushbutton_t *button, pushbutton_t *buttonList) {
                 
                 // if a radio group has been defined clear state of all other
                 // buttons in this group
-                processRadioGroup( button, buttonList);
+                processRadioGroup( button, buttonList, numButtons);
                 
                 // trigger callback function
                 if ( button->callback != NULL ) {
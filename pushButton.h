@@ -20,25 +20,33 @@
 #ifndef pushButton_h
 #define pushButton_h
 
+/* ----------------------------------------------------------------------------------- *
+ * Default debounce settings, number of equal samples to accept a new level
+ * ----------------------------------------------------------------------------------- */
+#define PRESS_SAMPLES    2
+#define RELEASE_SAMPLES  2
+
 /* ----------------------------------------------------------------------------------- *
  * Definition of a push button
  * ----------------------------------------------------------------------------------- */
 typedef struct pushbutton_t {
-    char    name;                  // button name
-    int     btnPin;                // Input pin
+    const char *name;              // button name
+    int     btnPin;                // Input pin, -1 if there is no physical button
     int     ledPin;                // LED indicating button state
     bool    state;                 // button state
     int     lastReading;           // last button reading
     bool    locked;                // when locked, button value can't be changed manually
     int     radioGroup;            // >  0 defines radio button group
     void    (*callback) (struct pushbutton_t *button); // callback for button state change
+    int     timerSlot;             // scheduler slot of a manual valve timer, -1 if none
 } pushbutton_t;
 
 /* ----------------------------------------------------------------------------------- *
  * Prototypes
  * ----------------------------------------------------------------------------------- */
-bool readButton(pushbutton_t *button, pushbutton_t *buttonList);  // read single button
-void pollButtons(pushbutton_t pushButtons[]);                     // poll all buttons
-void processRadioGroup(pushbutton_t *button, pushbutton_t *buttonList);
+bool readButton(pushbutton_t *button, pushbutton_t *buttonList, int numButtons, unsigned sample);
+bool pollButtons(pushbutton_t pushButtons[], int numButtons);     // poll all buttons
+void processRadioGroup(pushbutton_t *button, pushbutton_t *buttonList, int numButtons);
+void setDebounce(int pressSamples, int releaseSamples);           // debounce thresholds
 
 #endif /* pushButton_h */
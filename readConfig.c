@@ -19,229 +19,1023 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "yardControl.h"
 #include "readConfig.h"
 #include "logging.h"
 #include "persistState.h"
+#include "calendar.h"
+#include "eventLoop.h"
+#include "packer.h"
 
 /* ----------------------------------------------------------------------------------- *
  * Some globals we can't do without
  * ----------------------------------------------------------------------------------- */
 char *configFile    = CONFIG_FILE;            // configuration file
-sequence_t  sequence[2][MAX_STEP];            // two program sequences of max 40 steps
-starttime_t startTime[2][MAX_STARTTIMES+1];   // 10 start times for each sequence
+config_t *config    = NULL;                   // zones and programs
 connection_t mqttBroker;                      // mqtt broker settings
+int catchUp = CATCHUP;                        // catch up window for missed starts (min)
+bool asyncLog = ASYNCLOG;                      // format and write log in background thread
+int resumePolicy = RESUME;                     // continue interrupted sequence
+int samplePeriod   = SAMPLE_PERIOD_MS;        // button sample period in ms
+int pressSamples   = PRESS_SAMPLES;           // stable samples to accept a press
+int releaseSamples = RELEASE_SAMPLES;         // stable samples to accept a release
+expander_t expanders[HW_MAX_CHIPS] = {        // IO extenders, pin numbers count through them
+    { I2C_BUS_0, ADDR_IOEXT_0 }
+};
+int numExpanders = 1;
 
 /* ----------------------------------------------------------------------------------- *
- * Read config file
+ * Errors found in the config file, a reload is refused if there are any
  * ----------------------------------------------------------------------------------- */
-char *nextValue( char **cursor) {
-    while (**cursor && **cursor != ' ') (*cursor)++;                   /*   skip token */
-    **cursor = '\0'; (*cursor)++;                                      /* end of token */
-    while (**cursor && **cursor == ' ') (*cursor)++;                   /* skip spaces  */
-    return *cursor;
+static int parseErrors = 0;
+
+#define configError(...) do { parseErrors++; writeLog(LOG_ERR, __VA_ARGS__); } while (0)
+
+/* ----------------------------------------------------------------------------------- *
+ * A line of the config file split into tokens. Tokens point into the mapped file,
+ * nothing is copied and nothing is zero terminated.
+ * ----------------------------------------------------------------------------------- */
+#define MAX_TOKENS 8             // more tokens on a line are ignored
+
+typedef struct token_t {
+    const char *ptr;             // first character, NOT zero terminated
+    int         len;             // number of characters
+    int         col;             // column of first character, starting at 1
+} token_t;
+
+typedef struct line_t {
+    const char *text;            // complete line, for debug output
+    int         textLen;
+    int         lineNo;
+    int         numTokens;
+    token_t     token[MAX_TOKENS];
+} line_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Split next line of buffer into tokens, '#' starts a comment. Returns false at end
+ * of buffer.
+ * ----------------------------------------------------------------------------------- */
+static bool nextLine( const char **pos, const char *end, line_t *line ) {
+    const char *start = *pos;
+    if ( start >= end ) {
+        return false;
+    }
+    const char *eol = memchr(start, '\n', end-start);
+    if ( !eol ) {
+        eol = end;
+    }
+    *pos = eol+1;
+
+    line->text      = start;
+    line->textLen   = (int)(eol-start);
+    line->numTokens = 0;
+    line->lineNo++;
+
+    const char *cursor = start;
+    while ( line->numTokens < MAX_TOKENS ) {
+        while ( cursor < eol && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r') ) cursor++;
+        if ( cursor >= eol || *cursor == '#' ) {
+            break;
+        }
+        token_t *token = &line->token[line->numTokens++];
+        token->ptr = cursor;
+        token->col = (int)(cursor-start)+1;
+        while ( cursor < eol && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' ) cursor++;
+        token->len = (int)(cursor - token->ptr);
+    }
+    return true;
 }
 
-bool readConfig(void) {
-    FILE *fp = NULL;
-    fp = fopen(configFile, "rb");
-    int sequenceIdx, timeIdx[2], step = -1, offset=-1, lineNo=1;
-    bool retval = false;
+/* ----------------------------------------------------------------------------------- *
+ * Token <idx> of line, an empty token if the line is shorter
+ * ----------------------------------------------------------------------------------- */
+static const token_t *arg( const line_t *line, int idx ) {
+    static const token_t none = { "", 0, 0 };
+    return idx < line->numTokens ? &line->token[idx] : &none;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Report error at token <idx>, or behind the last token if it is missing
+ * ----------------------------------------------------------------------------------- */
+static void syntaxError( const line_t *line, int idx, const char *format, ... ) __attribute__ ((format (printf, 3, 4)));
+
+static void syntaxError( const line_t *line, int idx, const char *format, ... ) {
+    char    message[160];
+    va_list args;
+    int     col = 1;
+
+    if ( idx < line->numTokens ) {
+        col = line->token[idx].col;
+    } else if ( line->numTokens > 0 ) {
+        const token_t *last = &line->token[line->numTokens-1];
+        col = last->col + last->len + 1;
+    }
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    configError( "[%s:%04d:%d] ERROR: %s", configFile, line->lineNo, col, message );
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Compare token with word
+ * ----------------------------------------------------------------------------------- */
+static bool tokenIs( const token_t *token, const char *word ) {
+    return !strncmp(token->ptr, word, token->len) && word[token->len] == '\0';
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Interpret token as non negative number
+ * ----------------------------------------------------------------------------------- */
+static bool tokenInt( const token_t *token, int *value ) {
+    int result = 0;
+    if ( token->len == 0 || token->len > 9 ) {
+        return false;
+    }
+    for ( int idx=0; idx<token->len; idx++ ) {
+        if ( !isdigit((unsigned char)token->ptr[idx]) ) {
+            return false;
+        }
+        result = result*10 + (token->ptr[idx]-'0');
+    }
+    *value = result;
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Interpret token as I2C address, hex (0x20) or decimal
+ * ----------------------------------------------------------------------------------- */
+static bool tokenAddress( const token_t *token, int *value ) {
+    int result = 0;
+    if ( token->len < 3 || token->len > 4 || token->ptr[0] != '0' || tolower((unsigned char)token->ptr[1]) != 'x' ) {
+        return tokenInt(token, value);
+    }
+    for ( int idx=2; idx<token->len; idx++ ) {
+        if ( !isxdigit((unsigned char)token->ptr[idx]) ) {
+            return false;
+        }
+        int digit = tolower((unsigned char)token->ptr[idx]);
+        result = result*16 + (isdigit(digit) ? digit-'0' : digit-'a'+10);
+    }
+    *value = result;
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Interpret token as time of day, h:mm or hh:mm
+ * ----------------------------------------------------------------------------------- */
+static bool tokenTime( const token_t *token, int *hour, int *min ) {
+    const char *colon = memchr(token->ptr, ':', token->len);
+    if ( !colon ) {
+        return false;
+    }
+    token_t hh = { token->ptr, (int)(colon - token->ptr), token->col };
+    token_t mm = { colon+1, token->len - hh.len - 1, token->col + hh.len + 1 };
+    return hh.len >= 1 && hh.len <= 2 && mm.len == 2
+        && tokenInt(&hh, hour) && tokenInt(&mm, min) && *hour < 24 && *min < 60;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Copy token to a zero terminated string on the heap
+ * ----------------------------------------------------------------------------------- */
+static char *tokenDup( const token_t *token ) {
+    return strndup(token->ptr, token->len);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Keywords, those up to KW_TIME take effect on reload
+ * ----------------------------------------------------------------------------------- */
+typedef enum keyword_t {
+    KW_UNKNOWN,
+    KW_ZONE, KW_SEQUENCE, KW_VALVE, KW_PAUSE, KW_FLOW, KW_FLOWBUDGET, KW_SOAK, KW_MAXVALVES,
+    KW_TIME,
+    KW_STATEDIR, KW_ASYNCLOG, KW_RESUME, KW_CATCHUP, KW_SAMPLEPERIOD, KW_DEBOUNCE,
+    KW_MQTTBROKER, KW_MQTTPORT, KW_MQTTKEEPALIVE, KW_MQTTPREFIX, KW_MQTTCOMMAND,
+    KW_AUTOMATIC, KW_EXPANDER,
+} keyword_t;
+
+static const char *keywords[] = {
+    [KW_UNKNOWN]      = "",
+    [KW_ZONE]         = "ZONE",         [KW_SEQUENCE]     = "SEQUENCE",
+    [KW_VALVE]        = "VALVE",        [KW_PAUSE]        = "PAUSE",
+    [KW_FLOW]         = "FLOW",         [KW_FLOWBUDGET]   = "FLOWBUDGET",
+    [KW_SOAK]         = "SOAK",         [KW_MAXVALVES]    = "MAXVALVES",
+    [KW_TIME]         = "TIME",         [KW_STATEDIR]     = "STATEDIR",
+    [KW_ASYNCLOG]     = "ASYNCLOG",     [KW_RESUME]       = "RESUME",
+    [KW_CATCHUP]      = "CATCHUP",      [KW_SAMPLEPERIOD] = "SAMPLEPERIOD",
+    [KW_DEBOUNCE]     = "DEBOUNCE",     [KW_MQTTBROKER]   = "MQTTBROKER",
+    [KW_MQTTPORT]     = "MQTTPORT",     [KW_MQTTKEEPALIVE]= "MQTTKEEPALIVE",
+    [KW_MQTTPREFIX]   = "MQTTPREFIX",   [KW_MQTTCOMMAND]  = "MQTTCOMMAND",
+    [KW_AUTOMATIC]    = "AUTOMATIC",    [KW_EXPANDER]     = "EXPANDER",
+};
+
+/* ----------------------------------------------------------------------------------- *
+ * Length and one or two characters identify a keyword candidate, a single compare
+ * confirms it
+ * ----------------------------------------------------------------------------------- */
+static keyword_t lookupKeyword( const token_t *token ) {
+    const char *s  = token->ptr;
+    keyword_t   kw = KW_UNKNOWN;
+
+    switch ( token->len ) {
+        case 4:
+            switch ( s[0] ) {
+                case 'Z': kw = KW_ZONE;                                                         break;
+                case 'T': kw = KW_TIME;                                                         break;
+                case 'F': kw = KW_FLOW;                                                         break;
+                case 'S': kw = KW_SOAK;                                                         break;
+            }
+            break;
+        case 5:  kw = s[0] == 'V' ? KW_VALVE : s[0] == 'P' ? KW_PAUSE : KW_UNKNOWN;            break;
+        case 6:  kw = KW_RESUME;                                                                break;
+        case 7:  kw = KW_CATCHUP;                                                               break;
+        case 8:
+            switch ( s[0] ) {
+                case 'S': kw = s[1] == 'E' ? KW_SEQUENCE : KW_STATEDIR;                         break;
+                case 'A': kw = KW_ASYNCLOG;                                                     break;
+                case 'D': kw = KW_DEBOUNCE;                                                     break;
+                case 'E': kw = KW_EXPANDER;                                                     break;
+                case 'M': kw = KW_MQTTPORT;                                                     break;
+            }
+            break;
+        case 9:  kw = s[0] == 'M' ? KW_MAXVALVES : KW_AUTOMATIC;                              break;
+        case 10: kw = s[0] == 'F' ? KW_FLOWBUDGET : s[4] == 'B' ? KW_MQTTBROKER : KW_MQTTPREFIX; break;
+        case 11: kw = KW_MQTTCOMMAND;                                                           break;
+        case 12: kw = KW_SAMPLEPERIOD;                                                          break;
+        case 13: kw = KW_MQTTKEEPALIVE;                                                         break;
+    }
+    return kw != KW_UNKNOWN && !memcmp(s, keywords[kw], token->len) ? kw : KW_UNKNOWN;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Zones used if the config file doesn't define any
+ * ----------------------------------------------------------------------------------- */
+static const zone_t defaultZones[] = {
+    { "A", VALVE_A, BUTTON_A },
+    { "B", VALVE_B, BUTTON_B },
+    { "C", VALVE_C, BUTTON_C },
+    { "D", VALVE_D, BUTTON_D },
+};
+#define NUM_DEFAULT_ZONES (int)(sizeof(defaultZones)/sizeof(defaultZones[0]))
+
+/* ----------------------------------------------------------------------------------- *
+ * Start time as read, before it is sorted into its program
+ * ----------------------------------------------------------------------------------- */
+typedef struct rawTime_t {
+    int         id;              // sequence id given in TIME statement
+    int         lineNo;          // for error messages
+    int         col;
+    starttime_t time;
+} rawTime_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Upper bounds of what the config file defines, taken in a first pass
+ * ----------------------------------------------------------------------------------- */
+typedef struct configSize_t {
+    int    zones;
+    int    programs;
+    int    steps;
+    int    times;
+    size_t names;                // bytes for zone names
+    int    lines;
+} configSize_t;
+
+static void sizeConfig( const char *buffer, size_t length, configSize_t *size ) {
+    const char *pos = buffer;
+    line_t      line;
+
+    memset(size, 0, sizeof(configSize_t));
+    line.lineNo = 0;
+    while ( nextLine(&pos, buffer+length, &line) ) {
+        if ( line.numTokens > 0 ) {
+            switch ( lookupKeyword(&line.token[0]) ) {
+                case KW_ZONE:     size->zones++; size->names += ZONE_NAME_LEN; break;
+                case KW_SEQUENCE: size->programs++;                            break;
+                case KW_VALVE:    size->steps += 2;                            break;
+                case KW_TIME:     size->times++;                               break;
+                default:                                                       break;
+            }
+        }
+    }
+    size->lines = line.lineNo;
+    if ( size->zones == 0 ) {
+        size->zones = NUM_DEFAULT_ZONES;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Carve config and its arrays out of a single block
+ * ----------------------------------------------------------------------------------- */
+#define ALIGN(n) (((n) + sizeof(void*)-1) & ~(sizeof(void*)-1))
+
+static config_t *allocConfig( const configSize_t *size, rawTime_t **rawTimes, char **names ) {
+    size_t total = ALIGN(sizeof(config_t))
+                 + ALIGN(size->zones * sizeof(zone_t))
+                 + ALIGN(size->programs * sizeof(program_t))
+                 + ALIGN(size->steps/2 * sizeof(run_t))
+                 + ALIGN(size->steps * sizeof(sequence_t))
+                 + ALIGN((size->times + size->programs) * sizeof(starttime_t))
+                 + ALIGN(size->times * sizeof(rawTime_t))
+                 + ALIGN(size->names);
+    char *block = calloc(1, total);
+    if ( !block ) {
+        return NULL;
+    }
+
+    config_t *cfg = (config_t*)block;
+    char     *pos = block + ALIGN(sizeof(config_t));
+    cfg->size      = total;
+    cfg->zones     = (zone_t*)pos;       pos += ALIGN(size->zones * sizeof(zone_t));
+    cfg->programs  = (program_t*)pos;    pos += ALIGN(size->programs * sizeof(program_t));
+    // runs, steps and start times of all programs follow each other
+    if ( size->programs ) {
+        cfg->programs[0].runs       = (run_t*)pos;
+        cfg->programs[0].steps      = (sequence_t*)(pos + ALIGN(size->steps/2 * sizeof(run_t)));
+        cfg->programs[0].startTimes = (starttime_t*)((char*)cfg->programs[0].steps + ALIGN(size->steps * sizeof(sequence_t)));
+    }
+    pos += ALIGN(size->steps/2 * sizeof(run_t));
+    pos += ALIGN(size->steps * sizeof(sequence_t));
+    pos += ALIGN((size->times + size->programs) * sizeof(starttime_t));
+    *rawTimes = (rawTime_t*)pos;         pos += ALIGN(size->times * sizeof(rawTime_t));
+    *names    = pos;
+    return cfg;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Find zone by name, -1 if there is no such zone
+ * ----------------------------------------------------------------------------------- */
+static int findZone( const config_t *cfg, const token_t *name ) {
+    for ( int idx=0; idx<cfg->numZones; idx++ ) {
+        if ( !strncasecmp(cfg->zones[idx].name, name->ptr, name->len) && !cfg->zones[idx].name[name->len] ) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Find program by its SEQUENCE id
+ * ----------------------------------------------------------------------------------- */
+static program_t *programById( const config_t *cfg, int id ) {
+    for ( int idx=0; idx<cfg->numPrograms; idx++ ) {
+        if ( cfg->programs[idx].id == id ) {
+            return &cfg->programs[idx];
+        }
+    }
+    return NULL;
+}
+
+program_t *findProgram( int id ) {
+    return config ? programById(config, id) : NULL;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Hash of SEQUENCE ids while parsing, large configs would spend most of their time
+ * searching the program list otherwise. Slots hold program index + 1, 0 is free.
+ * ----------------------------------------------------------------------------------- */
+typedef struct idIndex_t {
+    int      *slot;
+    unsigned  mask;
+} idIndex_t;
+
+static bool idIndexInit( idIndex_t *index, int numPrograms ) {
+    unsigned size = 16;
+    while ( size < 2u*numPrograms ) size <<= 1;
+    index->mask = size-1;
+    index->slot = calloc(size, sizeof(int));
+    return index->slot != NULL;
+}
+
+// slot of program with given id, or the free slot to put it into
+static int *idSlot( const idIndex_t *index, const config_t *cfg, int id ) {
+    unsigned hash = ((unsigned)id * 2654435761u) & index->mask;
+    while ( index->slot[hash] && cfg->programs[index->slot[hash]-1].id != id ) {
+        hash = (hash+1) & index->mask;
+    }
+    return &index->slot[hash];
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Parse pin of IO extender, -1 if invalid. A plain number 0..15 is a pin of the
+ * first chip, others are given as <chip>:<port>:<bit>, e.g. 1:B:3, port A/B or 0/1.
+ * ----------------------------------------------------------------------------------- */
+static int parsePin( const token_t *token ) {
+    int pin, chip, port, bit;
+    const char *colon = memchr(token->ptr, ':', token->len);
+    if ( !colon ) {
+        return tokenInt(token, &pin) && pin < NUM_PINS ? PINBASE_0 + pin : -1;
+    }
+
+    token_t chipToken = { token->ptr, (int)(colon - token->ptr), token->col };
+    token_t bitToken  = { colon+3, token->len - chipToken.len - 3, token->col + chipToken.len + 3 };
+    if ( bitToken.len < 1 || colon[2] != ':' ) {
+        return -1;
+    }
+    switch ( toupper((unsigned char)colon[1]) ) {
+        case 'A': case '0': port = 0;  break;
+        case 'B': case '1': port = 1;  break;
+        default:            port = -1; break;
+    }
+    if ( port < 0 || !tokenInt(&chipToken, &chip) || chip >= HW_MAX_CHIPS || !tokenInt(&bitToken, &bit) || bit > 7 ) {
+        return -1;
+    }
+    return PINBASE_0 + chip*NUM_PINS + port*8 + bit;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Print pin the way it is given in the config file
+ * ----------------------------------------------------------------------------------- */
+static void printPin( int pin ) {
+    int chip = (pin-PINBASE_0) / NUM_PINS, bit = (pin-PINBASE_0) % NUM_PINS;
+    if ( chip == 0 ) {
+        printf(" %d", bit);
+    } else {
+        printf(" %d:%c:%d", chip, 'A' + bit/8, bit%8);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Sort start times into their programs, each list ends with tm_hour = -1
+ * ----------------------------------------------------------------------------------- */
+static void groupStartTimes( config_t *cfg, const idIndex_t *index, const rawTime_t *rawTimes, int numTimes ) {
+    starttime_t *next = cfg->numPrograms ? cfg->programs[0].startTimes : NULL;
+
+    // count start times of each program
+    for ( int idx=0; idx<numTimes; idx++ ) {
+        int prog = *idSlot(index, cfg, rawTimes[idx].id) - 1;
+        if ( prog < 0 ) {
+            configError( "[%s:%04d:%d] ERROR: TIME for undefined SEQUENCE %d",
+                     configFile, rawTimes[idx].lineNo, rawTimes[idx].col, rawTimes[idx].id );
+        } else {
+            cfg->programs[prog].numStartTimes++;
+        }
+    }
+
+    // lay out lists, then fill them in the order given
+    for ( int prog=0; prog<cfg->numPrograms; prog++ ) {
+        program_t *program = &cfg->programs[prog];
+        program->startTimes = next;
+        next += program->numStartTimes;
+        next->tm_hour = -1;                              // end marker
+        next++;
+        program->numStartTimes = 0;
+    }
+    for ( int idx=0; idx<numTimes; idx++ ) {
+        int prog = *idSlot(index, cfg, rawTimes[idx].id) - 1;
+        if ( prog >= 0 ) {
+            program_t *program = &cfg->programs[prog];
+            program->startTimes[program->numStartTimes++] = rawTimes[idx].time;
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Map config file, an empty file maps to an empty buffer
+ * ----------------------------------------------------------------------------------- */
+static const char *mapFile( const char *fileName, size_t *length ) {
+    struct stat st;
+    int fd = open(fileName, O_RDONLY);
+    if ( fd < 0 ) {
+        return NULL;
+    }
+    if ( fstat(fd, &st) < 0 ) {
+        close(fd);
+        return NULL;
+    }
+    *length = st.st_size;
+    const char *buffer = "";
+    if ( *length > 0 ) {
+        buffer = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( buffer == MAP_FAILED ) {
+            buffer = NULL;
+        }
+    }
+    close(fd);
+    return buffer;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Parse config file into a new config. On reload only zones and sequences are read,
+ * other settings are left alone. Returns NULL if out of memory, *found tells if
+ * the file could be read.
+ * ----------------------------------------------------------------------------------- */
+static config_t *parseConfig( bool reload, bool *found ) {
+    size_t       length   = 0;
+    const char  *buffer   = mapFile(configFile, &length);
+    int          pause=0, numTimes=0;
+    configSize_t size;
+    config_t    *cfg      = NULL;
+    program_t   *program  = NULL;                   // program being defined
+    rawTime_t   *rawTimes = NULL;
+    char        *names    = NULL;
+    bool         usedPins[HW_MAX_CHIPS*NUM_PINS] = { false };  // pins taken so far
+    bool         expanderSeen = false;              // first EXPANDER replaces the default
+    idIndex_t    index;
     
-    // start with two empty sequences
-    for ( int sequenceIdx=0; sequenceIdx <=1; sequenceIdx++ ) {
-        sequence[sequenceIdx][0].offset = -1;
-        for (int idx=0; idx<=MAX_STARTTIMES; idx++) {
-            startTime[sequenceIdx][idx].tm_hour  = -1;
-        }
-        timeIdx[sequenceIdx]=0;
-    }
-    mqttBroker.address   = NULL;
-    mqttBroker.port      = 1833;
-    mqttBroker.keepalive = 60;
-
-    // inititalize counter;
-    sequenceIdx = -1;
-    if (fp) {
-        char  *line=NULL;
-        char  *cursor;
-        size_t n=0;
-        size_t length = getline(&line, &n, fp);
-        systemMode = MANUAL_MODE;                            // default to manual mode
+    parseErrors = 0;
+    if ( !reload ) {
+        mqttBroker.address   = NULL;
+        mqttBroker.port      = 1833;
+        mqttBroker.keepalive = 60;
+        mqttBroker.prefix    = MQTT_PREFIX;
+        mqttBroker.command   = NULL;
+        expanders[0].bus     = I2C_BUS_0;
+        expanders[0].address = ADDR_IOEXT_0;
+        numExpanders         = 1;
+    }
+
+    // size up config, then allocate all of it at once
+    if (buffer) {
+        sizeConfig(buffer, length, &size);
+    } else {
+        memset(&size, 0, sizeof(size));
+        size.zones = NUM_DEFAULT_ZONES;
+    }
+    cfg = allocConfig(&size, &rawTimes, &names);
+    if ( !cfg || !idIndexInit(&index, size.programs) ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        if (buffer && length) munmap((void*)buffer, length);
+        free(cfg);
+        *found = false;
+        return NULL;
+    }
+
+    // pins of the control buttons and LEDs are fixed
+    int controlPins[] = { LED_S0, LED_S1, LED_RUN, LED_AUTO, BUTTON_RUN, BUTTON_AUTO, BUTTON_SELECT };
+    for ( int idx=0; idx<(int)(sizeof(controlPins)/sizeof(int)); idx++ ) {
+        usedPins[controlPins[idx]-PINBASE_0] = true;
+    }
+    if ( size.names == 0 ) {                       // no ZONE lines
+        memcpy(cfg->zones, defaultZones, sizeof(defaultZones));
+        cfg->numZones = NUM_DEFAULT_ZONES;
+    }
+
+    if (buffer) {
+        const char *pos = buffer;
+        line_t      line;
+        line.lineNo = 0;
+        if ( !reload ) {
+            systemMode = MANUAL_MODE;                        // default to manual mode
+        }
         
-        while ( length != -1) {
-            if ( length > 1 ) {                              /* skip empty lines       */
-                cursor = line;
-                if ( line[length-1] == '\n' ) {             /* remove trailing newline */
-                    line[length-1] = '\0';
+        while ( nextLine(&pos, buffer+length, &line) ) {
+            if ( line.numTokens == 0 ) {                     /* skip empty lines and comments */
+                continue;
+            }
+            const token_t *value = arg(&line, 1);
+            keyword_t      kw    = lookupKeyword(&line.token[0]);
+
+            writeLog(LOG_DEBUG, "IN: %.*s", line.textLen, line.text);
+
+            if ( reload && kw > KW_TIME ) {
+                writeLog(LOG_DEBUG, "  > %s takes effect after restart", keywords[kw]);
+                continue;
+            }
+
+            switch ( kw ) {
+                case KW_SEQUENCE: {
+                    int id;
+                    program = NULL;
+                    if ( !tokenInt(value, &id) ) {
+                        syntaxError( &line, 1, "Wrong sequence number '%.*s'", value->len, value->ptr );
+                    } else if ( *idSlot(&index, cfg, id) ) {
+                        syntaxError( &line, 1, "SEQUENCE %d defined twice, ignoring it", id );
+                    } else {
+                        // runs and steps follow those of the previous program
+                        program = &cfg->programs[cfg->numPrograms];
+                        if ( cfg->numPrograms > 0 ) {
+                            program_t *previous = program-1;
+                            program->runs  = previous->runs + previous->numRuns;
+                            program->steps = previous->steps + 2*previous->numRuns;
+                        }
+                        program->id = id;
+                        cfg->numPrograms++;
+                        *idSlot(&index, cfg, id) = cfg->numPrograms;
+                        pause = 0;
+                    }
+                    break;
                 }
-                
-                while ( *cursor == ' ' || *cursor == '\t' ) cursor++;
-                
-                if ( *cursor != '#') {                          /* skip '#' comments   */
-                    char *token = cursor;
-                    char *value = nextValue(&cursor);
-                    
-                    writeLog(LOG_DEBUG, "IN: %s %s", token, value);
-                    
-                    if (!strcmp(token, "SEQUENCE")) {
-                        sequenceIdx = atoi (value);
-                        if ( *value == '0' || *value == '1' ) {
-                            step    = 0;
-                            offset  = 0;
-                        } else {
-                            sequenceIdx = -1;
-                            writeLog( LOG_ERR, "[%s:%04d] ERROR: Wrong sequence number '%s' must be 0 or 1",
-                                     configFile, lineNo, value );
+                case KW_ZONE: {
+                    // expected format is "ZONE <name> <valve pin> [<button pin>]"
+                    const token_t *name   = value;
+                    const token_t *button = arg(&line, 3);
+                    int valvePin  = parsePin(arg(&line, 2));
+                    int buttonPin = button->len ? parsePin(button) : -1;
+                    int nameOk    = name->len > 0 && name->len < ZONE_NAME_LEN;
+                    for ( int idx=0; nameOk && idx<name->len; idx++ ) {
+                        nameOk = isalnum((unsigned char)name->ptr[idx]) || name->ptr[idx] == '_' || name->ptr[idx] == '-';
+                    }
+                    if ( !nameOk ) {
+                        syntaxError( &line, 1, "Bad zone name '%.*s'", name->len, name->ptr );
+                    } else if ( name->len == 1 && strchr("SRP", toupper((unsigned char)*name->ptr)) ) {
+                        syntaxError( &line, 1, "Zone name '%.*s' is reserved for a control button", name->len, name->ptr );
+                    } else if ( findZone(cfg, name) >= 0 ) {
+                        syntaxError( &line, 1, "ZONE %.*s defined twice", name->len, name->ptr );
+                    } else if ( valvePin < 0 ) {
+                        syntaxError( &line, 2, "ZONE expects pins 0..%d or chip:port:bit", NUM_PINS-1 );
+                    } else if ( button->len && buttonPin < 0 ) {
+                        syntaxError( &line, 3, "ZONE expects pins 0..%d or chip:port:bit", NUM_PINS-1 );
+                    } else if ( usedPins[valvePin-PINBASE_0] ) {
+                        syntaxError( &line, 2, "ZONE %.*s uses a pin that is already taken", name->len, name->ptr );
+                    } else if ( buttonPin >= 0 && (buttonPin == valvePin || usedPins[buttonPin-PINBASE_0]) ) {
+                        syntaxError( &line, 3, "ZONE %.*s uses a pin that is already taken", name->len, name->ptr );
+                    } else {
+                        zone_t *zone = &cfg->zones[cfg->numZones++];
+                        memcpy(names, name->ptr, name->len);
+                        names[name->len] = '\0';
+                        zone->name      = names;
+                        zone->valvePin  = valvePin;
+                        zone->buttonPin = buttonPin;
+                        names          += name->len+1;
+                        usedPins[valvePin-PINBASE_0] = true;
+                        if ( buttonPin >= 0 ) {
+                            usedPins[buttonPin-PINBASE_0] = true;
                         }
-                    } else if (!strcmp(token, "STATEDIR")) {
-                        stateDir = strdup(value);
-                        writeLog(LOG_DEBUG, "  > state kept in %s", stateDir);
-                    } else if (!strcmp(token, "TIME")) {
-                        // expected format is "TIME hh:mm s
-                        char *hh, *mm, *seq;
-                        int hour, min, idx;
-                        hh=value;
-                        mm=value+3;
-                        seq=value+6;
-                        *(value+2)='\0';
-                        *(value+5)='\0';
-                        *(value+7)='\0';
-                        hour = atoi(hh);
-                        min  = atoi(mm);
-                        idx  = atoi(seq);
-                        if( hour>=0 && hour<24 && min>=0 && min<60 && (*seq=='0'||*seq=='1')) {
-                            if ( timeIdx[idx] < MAX_STARTTIMES ) {
-                                startTime[idx][timeIdx[idx]].tm_min  = min;
-                                startTime[idx][timeIdx[idx]].tm_hour = hour;
-                                timeIdx[idx]++;
-                            } else {
-                                writeLog( LOG_ERR, "[%s:%04d] ERROR: Maximum TIME statements of %02d exceeded\n",
-                                         configFile, lineNo, MAX_STARTTIMES );
+                    }
+                    break;
+                }
+                case KW_TIME: {
+                    // expected format is "TIME h[h]:mm s [<days>|EVERY <n>]"
+                    const token_t *rule = arg(&line, 3);
+                    int hour, min, id, days = ALL_DAYS, interval = 1;
+                    if ( !tokenTime(value, &hour, &min) ) {
+                        syntaxError( &line, 1, "TIME expected as hh:mm s [MO,TU,..|EVERY n]" );
+                    } else if ( !tokenInt(arg(&line, 2), &id) ) {
+                        syntaxError( &line, 2, "TIME expects a sequence number" );
+                    } else {
+                        if ( rule->len >= 5 && !strncmp(rule->ptr, "EVERY", 5) ) {
+                            // "EVERY <n>", "EVERY<n>" is fine as well
+                            token_t count = { rule->ptr+5, rule->len-5, rule->col+5 };
+                            int     idx   = count.len ? 3 : 4;
+                            if ( !tokenInt(count.len ? &count : arg(&line, 4), &interval)
+                                || interval < 1 || interval > MAX_INTERVAL ) {
+                                syntaxError( &line, idx, "EVERY expects 1..%d days", MAX_INTERVAL );
+                                interval = -1;
+                            }
+                        } else if ( rule->len ) {
+                            days = calendarParseDays(rule->ptr, rule->len);
+                            if ( days <= 0 ) {
+                                syntaxError( &line, 3, "Week days expected as MO,TU,.. not '%.*s'", rule->len, rule->ptr );
                             }
-                        } else {
-                            writeLog( LOG_ERR, "[%s:%04d] ERROR: TIME expected as hh:mm s", configFile, lineNo );
-                        }
-                    } else if (!strcmp(token, "MQTTBROKER")) {
-                        mqttBroker.address = strdup(value);
-                    } else if (!strcmp(token, "MQTTPORT")) {
-                        mqttBroker.port = atoi(value);
-                    } else if (!strcmp(token, "MQTTKEEPALIVE")) {
-                        mqttBroker.keepalive = atoi(value);
-                    } else if (!strcmp(token, "MQTTPREFIX")) {
-                        mqttBroker.prefix = strdup(value);
-                    } else if (!strcmp(token, "AUTOMATIC")) {
-                        if (!strcmp(value, "ON")) {
-                            systemMode = AUTOMATIC_MODE;
-                            writeLog(LOG_DEBUG, "  > automatic mode");
-                        } else if (!strcmp(value, "PERSIST")) {
-                            systemMode = readState("automatic") ? AUTOMATIC_MODE : MANUAL_MODE;
-                        } else {
-                            systemMode = MANUAL_MODE;
-                            writeLog(LOG_DEBUG, "  > manual mode");
                         }
-                    } else if (!strcmp(token, "PAUSE")) {
-                        int time  = atoi(value);
-                        if (time > 0 ) {
-                            offset+=(time*TIME_SCALE-1);
-                        } else {
-                            writeLog( LOG_ERR, "[%s:%04d] ERROR: Wromg time in DELAY: %d", configFile, lineNo, time );
+                        if ( days > 0 && interval > 0 ) {
+                            // sorted into its program once all sequences are known
+                            rawTime_t *raw = &rawTimes[numTimes++];
+                            raw->id                 = id;
+                            raw->lineNo             = line.lineNo;
+                            raw->col                = line.token[2].col;
+                            raw->time.tm_min        = min;
+                            raw->time.tm_hour       = hour;
+                            raw->time.days          = days;
+                            raw->time.interval      = interval;
                         }
-                    } else if (!strcmp(token, "VALVE")) {
-                        char *valve = cursor;
-                        int time  = atoi(nextValue(&cursor));
-                        int buttonIdx;
-                        if (time > 0 ) {
-                            buttonIdx = toupper(*valve) - 'A';  // A->0, B->1, C->2, D->3
-                            if ( buttonIdx >= 0 && buttonIdx <= 3 && step < (MAX_STEP-2)) {   // Add step to sequence
-                                
-                                // turn valve on
-                                sequence[sequenceIdx][step].offset = offset;
-                                sequence[sequenceIdx][step].valve  = &pushButtons[buttonIdx];
-                                sequence[sequenceIdx][step].state  = true;
-                                step++;
-                                offset += (time*TIME_SCALE);
-                                
-                                // turn valve off
-                                sequence[sequenceIdx][step].offset = offset;
-                                sequence[sequenceIdx][step].valve  = &pushButtons[buttonIdx];
-                                sequence[sequenceIdx][step].state  = false;
-                                step++;
-                                offset++;
-                                
-                                // Add End marker
-                                sequence[sequenceIdx][step].offset = -1;
-                            } else {
-                                if ( step >= (MAX_STEP-2) ) {
-                                    writeLog( LOG_ERR, "[%s:%04d] ERROR: Sequence too long, ignoring line", configFile, lineNo );
-                                } else {
-                                    writeLog( LOG_ERR, "[%s:%04d] ERROR: Unknown VALVE: %s", configFile, lineNo, valve );
-                                }
+                    }
+                    break;
+                }
+                case KW_STATEDIR:
+                    stateDir = tokenDup(value);
+                    writeLog(LOG_DEBUG, "  > state kept in %s", stateDir);
+                    break;
+                case KW_ASYNCLOG: {
+                    int on;
+                    if ( tokenInt(value, &on) ) {
+                        asyncLog = on ? true : false;
+                    } else {
+                        syntaxError( &line, 1, "ASYNCLOG expects 0 or 1" );
+                    }
+                    break;
+                }
+                case KW_RESUME:
+                    if ( tokenIs(value, "OFF") ) {
+                        resumePolicy = RESUME_OFF;
+                    } else if ( tokenIs(value, "OFFSET") ) {
+                        resumePolicy = RESUME_OFFSET;
+                    } else if ( tokenIs(value, "STEP") ) {
+                        resumePolicy = RESUME_STEP;
+                    } else {
+                        syntaxError( &line, 1, "RESUME must be OFF, OFFSET or STEP" );
+                    }
+                    break;
+                case KW_CATCHUP:
+                    if ( !tokenInt(value, &catchUp) ) {
+                        syntaxError( &line, 1, "Wrong time in CATCHUP: %.*s", value->len, value->ptr );
+                        catchUp = CATCHUP;
+                    }
+                    break;
+                case KW_SAMPLEPERIOD:
+                    if ( !tokenInt(value, &samplePeriod) || samplePeriod < 1 || samplePeriod > 1000 ) {
+                        syntaxError( &line, 1, "SAMPLEPERIOD must be 1..1000 ms" );
+                        samplePeriod = SAMPLE_PERIOD_MS;
+                    }
+                    break;
+                case KW_DEBOUNCE:
+                    // expected format is "DEBOUNCE <press> <release>"
+                    if ( !tokenInt(value, &pressSamples) || pressSamples < 1 || pressSamples > 15 ) {
+                        syntaxError( &line, 1, "DEBOUNCE expects two sample counts of 1..15" );
+                        pressSamples   = PRESS_SAMPLES;
+                        releaseSamples = RELEASE_SAMPLES;
+                    } else if ( !tokenInt(arg(&line, 2), &releaseSamples) || releaseSamples < 1 || releaseSamples > 15 ) {
+                        syntaxError( &line, 2, "DEBOUNCE expects two sample counts of 1..15" );
+                        pressSamples   = PRESS_SAMPLES;
+                        releaseSamples = RELEASE_SAMPLES;
+                    }
+                    break;
+                case KW_MQTTBROKER:
+                    mqttBroker.address = tokenDup(value);
+                    break;
+                case KW_MQTTPORT:
+                    if ( !tokenInt(value, &mqttBroker.port) ) {
+                        syntaxError( &line, 1, "MQTTPORT expects a port number" );
+                    }
+                    break;
+                case KW_MQTTKEEPALIVE:
+                    if ( !tokenInt(value, &mqttBroker.keepalive) ) {
+                        syntaxError( &line, 1, "MQTTKEEPALIVE expects seconds" );
+                    }
+                    break;
+                case KW_MQTTPREFIX:
+                    mqttBroker.prefix = tokenDup(value);
+                    break;
+                case KW_MQTTCOMMAND:
+                    mqttBroker.command = tokenDup(value);
+                    break;
+                case KW_AUTOMATIC:
+                    if ( tokenIs(value, "ON") ) {
+                        systemMode = AUTOMATIC_MODE;
+                        writeLog(LOG_DEBUG, "  > automatic mode");
+                    } else if ( tokenIs(value, "PERSIST") ) {
+                        systemMode = readState("automatic") ? AUTOMATIC_MODE : MANUAL_MODE;
+                    } else {
+                        systemMode = MANUAL_MODE;
+                        writeLog(LOG_DEBUG, "  > manual mode");
+                    }
+                    break;
+                case KW_PAUSE: {
+                    int time;
+                    if ( tokenInt(value, &time) && time > 0 ) {
+                        pause += time;
+                    } else {
+                        syntaxError( &line, 1, "Wrong time in PAUSE: %.*s", value->len, value->ptr );
+                    }
+                    break;
+                }
+                case KW_VALVE: {
+                    int time, zoneIdx;
+                    if ( !tokenInt(arg(&line, 2), &time) || time <= 0 ) {
+                        syntaxError( &line, 2, "Wrong time in VALVE: %.*s", arg(&line, 2)->len, arg(&line, 2)->ptr );
+                    } else if ( !program ) {
+                        syntaxError( &line, 0, "VALVE outside of a SEQUENCE" );
+                    } else if ( (zoneIdx = findZone(cfg, value)) < 0 ) {
+                        syntaxError( &line, 1, "Unknown VALVE: %.*s", value->len, value->ptr );
+                    } else {                                 // Add run to sequence, steps are laid out later
+                        run_t *run = &program->runs[program->numRuns++];
+                        run->valve    = zoneIdx;
+                        run->duration = time;
+                        run->pause    = pause;
+                        pause = 0;
+                    }
+                    break;
+                }
+                case KW_EXPANDER: {
+                    // expected format is "EXPANDER <bus> <address>", chips are numbered in order
+                    int bus, address, chip = expanderSeen ? numExpanders : 0;
+                    if ( !tokenInt(value, &bus) ) {
+                        syntaxError( &line, 1, "EXPANDER expects the number of an i2c bus" );
+                    } else if ( !tokenAddress(arg(&line, 2), &address) || address < 0x20 || address > 0x27 ) {
+                        syntaxError( &line, 2, "EXPANDER expects an address of 0x20..0x27" );
+                    } else if ( chip >= HW_MAX_CHIPS ) {
+                        syntaxError( &line, 0, "More than %d EXPANDERs", HW_MAX_CHIPS );
+                    } else {
+                        for ( int idx=0; expanderSeen && idx<numExpanders; idx++ ) {
+                            if ( expanders[idx].bus == bus && expanders[idx].address == address ) {
+                                syntaxError( &line, 2, "EXPANDER %d 0x%02x defined twice", bus, address );
+                                chip = -1;
+                                break;
                             }
-                        } else {
-                            writeLog( LOG_ERR, "[%s:%04d] ERROR: Wromg time in VALVE: %d", configFile, lineNo, time );
                         }
+                        if ( chip >= 0 ) {
+                            expanders[chip].bus     = bus;
+                            expanders[chip].address = address;
+                            numExpanders            = chip+1;
+                            expanderSeen            = true;
+                        }
+                    }
+                    break;
+                }
+                case KW_FLOW: {
+                    // expected format is "FLOW <zone> <flow>", in any unit FLOWBUDGET uses
+                    int flow, zoneIdx;
+                    if ( (zoneIdx = findZone(cfg, value)) < 0 ) {
+                        syntaxError( &line, 1, "Unknown zone in FLOW: %.*s", value->len, value->ptr );
+                    } else if ( !tokenInt(arg(&line, 2), &flow) || flow <= 0 ) {
+                        syntaxError( &line, 2, "FLOW expects a flow rate > 0" );
+                    } else {
+                        cfg->zones[zoneIdx].flow = flow;
+                    }
+                    break;
+                }
+                case KW_SOAK: {
+                    // expected format is "SOAK <zone> <min>"
+                    int soak, zoneIdx;
+                    if ( (zoneIdx = findZone(cfg, value)) < 0 ) {
+                        syntaxError( &line, 1, "Unknown zone in SOAK: %.*s", value->len, value->ptr );
+                    } else if ( !tokenInt(arg(&line, 2), &soak) ) {
+                        syntaxError( &line, 2, "SOAK expects minutes" );
                     } else {
-                        writeLog( LOG_ERR, "[%s:%04d] WARNING: Skipping unknown command: %s", configFile, lineNo, token );
+                        cfg->zones[zoneIdx].soak = soak;
                     }
+                    break;
                 }
+                case KW_MAXVALVES:
+                    if ( !tokenInt(value, &cfg->maxValves) ) {
+                        syntaxError( &line, 1, "MAXVALVES expects a number of valves, 0 for no limit" );
+                        cfg->maxValves = 0;
+                    }
+                    break;
+                case KW_FLOWBUDGET:
+                    if ( !tokenInt(value, &cfg->flowBudget) ) {
+                        syntaxError( &line, 1, "FLOWBUDGET expects a flow rate, 0 for no limit" );
+                        cfg->flowBudget = 0;
+                    }
+                    break;
+                case KW_UNKNOWN:
+                    writeLog( LOG_ERR, "[%s:%04d:%d] WARNING: Skipping unknown command: %.*s", configFile,
+                             line.lineNo, line.token[0].col, line.token[0].len, line.token[0].ptr );
+                    break;
             }
-            free(line);
-            n=0;
-            length = getline(&line, &n, fp);
-            lineNo++;
-            retval = true;
         }
-        fclose(fp);
+        if ( length ) {
+            munmap((void*)buffer, length);
+        }
+    }
+
+    if ( cfg->numZones == 0 ) {
+        configError( "ERROR: %s defines no usable ZONE", configFile );
+    }
+    // a pin on an undefined expander would drive some other pin, don't start with it
+    int badPins = 0;
+    for ( int idx=0; idx<cfg->numZones; idx++ ) {
+        const zone_t *zone = &cfg->zones[idx];
+        int pin = (zone->buttonPin > zone->valvePin ? zone->buttonPin : zone->valvePin) - PINBASE_0;
+        if ( pin / NUM_PINS >= numExpanders ) {
+            configError( "ERROR: ZONE %s uses a pin of EXPANDER %d, only %d defined",
+                         zone->name, pin / NUM_PINS, numExpanders );
+            badPins++;
+        }
+    }
+    if ( badPins && !reload ) {
+        free(index.slot);
+        free(cfg);
+        *found = buffer != NULL;
+        return NULL;
+    }
+    groupStartTimes(cfg, &index, rawTimes, numTimes);
+    free(index.slot);
+    for ( int idx=0; idx<cfg->numPrograms; idx++ ) {
+        if ( !packProgram(cfg, &cfg->programs[idx]) ) {
+            free(cfg);
+            *found = false;
+            return NULL;
+        }
+    }
+    *found = buffer != NULL;
+    return cfg;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Read config file at startup
+ * ----------------------------------------------------------------------------------- */
+bool readConfig(void) {
+    bool retval;
+    config_t *cfg = parseConfig(false, &retval);
+    if ( !cfg ) {
+        return false;
+    }
+    free(config);
+    config = cfg;
+
+    // commands go to a sibling of the state prefix: /YardControl/State -> /YardControl/Command
+    if ( !mqttBroker.command ) {
+        const char *slash = strrchr(mqttBroker.prefix, '/');
+        int baseLen = slash ? (int)(slash - mqttBroker.prefix) : (int)strlen(mqttBroker.prefix);
+        mqttBroker.command = malloc(baseLen + 9);
+        sprintf(mqttBroker.command, "%.*s/Command", baseLen, mqttBroker.prefix);
     }
     return retval;
 }
 
 /* ----------------------------------------------------------------------------------- *
- * Dump sequence definition
+ * Read config file again, returns new config or NULL if it can't be used. The
+ * active config is not touched, the caller swaps it.
+ *
+ * Zones are wired to buttons, topics and pins at startup, so they must not change.
  * ----------------------------------------------------------------------------------- */
-void dumpSequence( int sequenceIdx ) {
-    int step = 0;
-    int lastON = 0, lastOFF = 0;
-    sequence_t *seq = sequence[sequenceIdx];
-    
-    if ( seq[0].offset >=0 ) {
-        printf("# ----------------------------------------------------------------------------------- #\n");
-        printf("SEQUENCE %d\n", sequenceIdx);
-        printf("# ----------------------------------------------------------------------------------- #\n");
-        
-        while ( seq[step].offset >= 0 ) {
-            if ( seq[step].state ) {
-                if ( seq[step].offset > (lastOFF+1) ) {
-                    printf("  PAUSE %d\n", (seq[step].offset-lastOFF)/TIME_SCALE );
-                }
-                lastON = seq[step].offset;
-            } else {
-                printf("  VALVE %c %d\n", seq[step].valve->name, (seq[step].offset-lastON)/TIME_SCALE );
-                lastOFF = seq[step].offset;
-            }
-            printf("#                     %03d t+%04d %c %s\n",
-                   step,
-                   seq[step].offset,
-                   seq[step].valve->name,
-                   seq[step].state? "ON":"OFF");
-            step++;
+config_t *reloadConfig(void) {
+    bool found;
+    config_t *cfg = parseConfig(true, &found);
+
+    if ( !cfg ) {
+        writeLog(LOG_ERR, "Reload failed: out of memory");
+        return NULL;
+    }
+    if ( !found ) {
+        writeLog(LOG_ERR, "Reload failed: can't read %s", configFile);
+        free(cfg);
+        return NULL;
+    }
+    if ( parseErrors > 0 ) {
+        writeLog(LOG_ERR, "Reload failed: %d errors in %s", parseErrors, configFile);
+        free(cfg);
+        return NULL;
+    }
+    if ( cfg->numZones != config->numZones ) {
+        writeLog(LOG_ERR, "Reload failed: number of zones changed from %d to %d, restart needed",
+                 config->numZones, cfg->numZones);
+        free(cfg);
+        return NULL;
+    }
+    for ( int idx=0; idx<cfg->numZones; idx++ ) {
+        const zone_t *old = &config->zones[idx], *fresh = &cfg->zones[idx];
+        if ( strcmp(old->name, fresh->name) || old->valvePin != fresh->valvePin || old->buttonPin != fresh->buttonPin ) {
+            writeLog(LOG_ERR, "Reload failed: zone %s changed, restart needed", old->name);
+            free(cfg);
+            return NULL;
         }
-    } else {
-        printf("# ----------------------------------------------------------------------------------- #\n");
-        printf("# Sequence %d not defined                                                             #\n", sequenceIdx );
-        printf("# ----------------------------------------------------------------------------------- #\n");
     }
+    return cfg;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Dump zone and sequence definitions
+ * ----------------------------------------------------------------------------------- */
+static void dumpProgram( const config_t *cfg, const program_t *program ) {
+    const sequence_t *seq = program->steps;
 
-    int timeIdx=0;
-    while(startTime[sequenceIdx][timeIdx].tm_hour >= 0 ) {
-        if ( startTime[sequenceIdx][timeIdx].tm_hour >= 0 ) {
-            printf( "  TIME %02d:%02d %d\n", startTime[sequenceIdx][timeIdx].tm_hour,
-                   startTime[sequenceIdx][timeIdx].tm_min,
-                   sequenceIdx);
+    printf("# ----------------------------------------------------------------------------------- #\n");
+    printf("SEQUENCE %d\n", program->id);
+    printf("# ----------------------------------------------------------------------------------- #\n");
+
+    for ( int run=0; run<program->numRuns; run++ ) {
+        if ( program->runs[run].pause > 0 ) {
+            printf("  PAUSE %d\n", program->runs[run].pause);
         }
-        timeIdx++;
+        printf("  VALVE %s %d\n", cfg->zones[program->runs[run].valve].name, program->runs[run].duration);
+    }
+    for ( int step=0; step<program->numSteps; step++ ) {
+        printf("#                     %03d t+%04d %s %s\n",
+               step,
+               seq[step].offset,
+               cfg->zones[seq[step].valve].name,
+               seq[step].state? "ON":"OFF");
+    }
+
+    for ( int timeIdx=0; timeIdx<program->numStartTimes; timeIdx++ ) {
+        const starttime_t *start = &program->startTimes[timeIdx];
+        char rule[32];
+        calendarFormatRule(start, rule, sizeof(rule));
+        printf( "  TIME %02d:%02d %d%s\n", start->tm_hour, start->tm_min, program->id, rule);
     }
+}
 
+void dumpConfig( void ) {
+    if ( !config ) {
+        return;
+    }
+    printf("# ----------------------------------------------------------------------------------- #\n");
+    printf("# %d zones, %d sequences, %zu bytes\n", config->numZones, config->numPrograms, config->size);
+    printf("# ----------------------------------------------------------------------------------- #\n");
+    for ( int idx=0; idx<numExpanders; idx++ ) {
+        printf("EXPANDER %d 0x%02x\n", expanders[idx].bus, expanders[idx].address);
+    }
+    for ( int idx=0; idx<config->numZones; idx++ ) {
+        const zone_t *zone = &config->zones[idx];
+        printf("ZONE %s", zone->name);
+        printPin(zone->valvePin);
+        if ( zone->buttonPin >= 0 ) {
+            printPin(zone->buttonPin);
+        }
+        printf("\n");
+    }
+    for ( int idx=0; idx<config->numZones; idx++ ) {
+        if ( config->zones[idx].flow > 0 ) {
+            printf("FLOW %s %d\n", config->zones[idx].name, config->zones[idx].flow);
+        }
+        if ( config->zones[idx].soak > 0 ) {
+            printf("SOAK %s %d\n", config->zones[idx].name, config->zones[idx].soak);
+        }
+    }
+    if ( config->flowBudget > 0 ) {
+        printf("FLOWBUDGET %d\n", config->flowBudget);
+    }
+    if ( config->maxValves > 0 ) {
+        printf("MAXVALVES %d\n", config->maxValves);
+    }
+    for ( int idx=0; idx<config->numPrograms; idx++ ) {
+        dumpProgram(config, &config->programs[idx]);
+    }
 }
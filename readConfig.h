@@ -16,6 +16,7 @@
 /*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
 /* *********************************************************************************** */
 #include "pushButton.h"
+#include "hardware.h"
 
 #ifndef readConfig_h
 #define readConfig_h
@@ -23,21 +24,44 @@
 /* ----------------------------------------------------------------------------------- *
  * Settings
  * ----------------------------------------------------------------------------------- */
-#define MAX_STEP        100  // max 100 steps per sequence (50 commands)
 #define TIME_SCALE       60  // unit scale fpr secuence, set to 60 to get minutes
-#define MAX_STARTTIMES   10  // allow for 10 different starttimes
+#define ZONE_NAME_LEN    16  // longest zone name + 1
+#define CATCHUP           0  // minutes a missed start time may run late
+#define ASYNCLOG       true  // log from background thread
+#define RESUME  RESUME_OFFSET  // continue interrupted sequence on original time line
 #define CONFIG_FILE  "/etc/yardControl.cfg"            // read config from etc
+#define MQTT_PREFIX  "/YardControl/State"              // prefix for published topics
+
+/* ----------------------------------------------------------------------------------- *
+ * A zone: a valve with an optional push button to switch it manually
+ * ----------------------------------------------------------------------------------- */
+typedef struct zone_t {
+    const char *name;        // name used in sequences and MQTT topics
+    int         valvePin;    // output pin of valve, the button LED is wired to it
+    int         buttonPin;   // input pin of push button, -1 if there is none
+    int         flow;        // flow rate when open, 0 if not rated
+    int         soak;        // minutes to stay closed between two runs
+} zone_t;
 
 /* ----------------------------------------------------------------------------------- *
  * A step in a sequence
  * ----------------------------------------------------------------------------------- */
 typedef struct sequence_t {
     int          offset;     // offset after sequence start this action shall be triggered
-    pushbutton_t *valve;     // valve to be switched
+    int          valve;      // index of zone to be switched
     bool         state;      // new state of valve
     bool         done;       // step done or still open?
 } sequence_t;
 
+/* ----------------------------------------------------------------------------------- *
+ * A VALVE line of a sequence, steps are laid out from these
+ * ----------------------------------------------------------------------------------- */
+typedef struct run_t {
+    int          valve;      // index of zone
+    int          duration;   // minutes open
+    int          pause;      // minutes of PAUSE before, all valves closed
+} run_t;
+
 /* ----------------------------------------------------------------------------------- *
  * Connection settings
  * ----------------------------------------------------------------------------------- */
@@ -45,7 +69,8 @@ typedef struct connection_t {
     char *address;
     int  port;
     int  keepalive;
-    char *prefix;
+    char *prefix;            // prefix for published states
+    char *command;           // prefix for command topics we subscribe to
 } connection_t;
 
 /* ----------------------------------------------------------------------------------- *
@@ -54,21 +79,59 @@ typedef struct connection_t {
 typedef struct starttime_t {
     int tm_min;
     int tm_hour;
+    int days;                // week days to run on, bit 0 = sunday
+    int interval;            // run every <interval> days, 1 = daily
 } starttime_t;
 
+/* ----------------------------------------------------------------------------------- *
+ * A program: sequence of steps and the times to start it automatically
+ * ----------------------------------------------------------------------------------- */
+typedef struct program_t {
+    int          id;             // number given with SEQUENCE <id>
+    run_t       *runs;           // VALVE lines as given
+    int          numRuns;
+    sequence_t  *steps;          // steps ordered by offset
+    int          numSteps;
+    starttime_t *startTimes;     // terminated by an entry with tm_hour < 0
+    int          numStartTimes;
+} program_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Zones and programs as read from the config file. Everything lives in one block
+ * of memory, allocated once the file has been sized up.
+ * ----------------------------------------------------------------------------------- */
+typedef struct config_t {
+    zone_t      *zones;
+    int          numZones;
+    program_t   *programs;
+    int          numPrograms;
+    int          flowBudget;     // flow the supply allows for, 0: no limit by flow
+    int          maxValves;      // valves open at a time, 0: no limit by count
+    size_t       size;           // size of the block including this header
+} config_t;
+
 /* ----------------------------------------------------------------------------------- *
  * Some globals we can't do without
  * ----------------------------------------------------------------------------------- */
 extern char *configFile;                            // configuration file
 extern char *stateDir;                              // directory for state files
-extern sequence_t  sequence[2][MAX_STEP];           // two program sequences of max 40 steps
-extern starttime_t startTime[2][MAX_STARTTIMES+1];  // start times for each sequence
+extern config_t *config;                            // zones and programs
 extern connection_t mqttBroker;                     // address:port of MQTT broker
+extern int catchUp;                                 // catch up window for missed starts
+extern bool asyncLog;                               // log from background thread
+extern int resumePolicy;                            // RESUME_OFF, RESUME_OFFSET, RESUME_STEP
+extern int samplePeriod;                            // button sample period in ms
+extern int pressSamples;                            // stable samples to accept a press
+extern int releaseSamples;                          // stable samples to accept a release
+extern expander_t expanders[];                      // IO extenders, chip 0 first
+extern int numExpanders;
 
 /* ----------------------------------------------------------------------------------- *
  * Prototypes
  * ----------------------------------------------------------------------------------- */
 bool readConfig (void);                  // read and parse config file
-void dumpSequence(int sequenceIdx);      // dump configuration in config file format
+config_t *reloadConfig(void);            // read config file again, NULL if it can't be used
+void dumpConfig(void);                   // dump configuration in config file format
+program_t *findProgram(int id);          // program by SEQUENCE id, NULL if undefined
 
 #endif /* readConfig_h */
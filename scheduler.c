@@ -0,0 +1,220 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "scheduler.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * The heap
+ * ----------------------------------------------------------------------------------- */
+static schedEntry_t *heap     = NULL;         // heap[0] is due first
+static int           size     = 0;            // number of entries
+static int           capacity = 0;            // allocated entries
+static int          *pending  = NULL;         // steps queued per sequence
+static int           numPending = 0;          // sequences counted in pending
+
+/* ----------------------------------------------------------------------------------- *
+ * Counter of queued steps of a sequence, grown as needed. Negative sequences aren't
+ * counted, NULL is returned for them.
+ * ----------------------------------------------------------------------------------- */
+static int *pendingCount( int sequence, bool grow ) {
+    if ( sequence < 0 || (sequence >= numPending && !grow) ) {
+        return NULL;
+    }
+    if ( sequence >= numPending ) {
+        int newLen = numPending ? numPending : 16;
+        while ( newLen <= sequence ) {
+            newLen *= 2;
+        }
+        int *newPending = realloc(pending, newLen * sizeof(int));
+        if ( !newPending ) {
+            return NULL;
+        }
+        for ( int idx=numPending; idx<newLen; idx++ ) {
+            newPending[idx] = 0;
+        }
+        pending    = newPending;
+        numPending = newLen;
+    }
+    return &pending[sequence];
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Order by deadline, steps due at the same time fire in sequence order
+ * ----------------------------------------------------------------------------------- */
+static bool before( const schedEntry_t *a, const schedEntry_t *b ) {
+    if ( a->deadline != b->deadline ) return a->deadline < b->deadline;
+    if ( a->sequence != b->sequence ) return a->sequence < b->sequence;
+    return a->step < b->step;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Put entry into heap slot, tell its owner where it is
+ * ----------------------------------------------------------------------------------- */
+static void place( int idx, schedEntry_t entry ) {
+    heap[idx] = entry;
+    if ( entry.slot ) {
+        *entry.slot = idx;
+    }
+}
+
+static void siftUp( int idx ) {
+    schedEntry_t entry = heap[idx];
+    while ( idx > 0 ) {
+        int parent = (idx-1)/2;
+        if ( !before(&entry, &heap[parent]) ) break;
+        place(idx, heap[parent]);
+        idx = parent;
+    }
+    place(idx, entry);
+}
+
+static void siftDown( int idx ) {
+    schedEntry_t entry = heap[idx];
+    for ( ;; ) {
+        int child = 2*idx+1;
+        if ( child >= size ) break;
+        if ( child+1 < size && before(&heap[child+1], &heap[child]) ) child++;
+        if ( !before(&heap[child], &entry) ) break;
+        place(idx, heap[child]);
+        idx = child;
+    }
+    place(idx, entry);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Add step to the heap, slot (if given) follows the entry while it is queued
+ * ----------------------------------------------------------------------------------- */
+bool schedulerAddTimer( time_t deadline, int sequence, int step, int *slot ) {
+    if ( size == capacity ) {
+        int newCapacity = capacity ? capacity*2 : 64;
+        schedEntry_t *newHeap = realloc(heap, newCapacity * sizeof(schedEntry_t));
+        if ( !newHeap ) {
+            writeLog(LOG_ERR, "Error: Out of memory, can't schedule step %d of sequence %02d", step, sequence);
+            return false;
+        }
+        heap     = newHeap;
+        capacity = newCapacity;
+    }
+    int *count = pendingCount(sequence, true);
+    if ( !count && sequence >= 0 ) {
+        writeLog(LOG_ERR, "Error: Out of memory, can't schedule step %d of sequence %02d", step, sequence);
+        return false;
+    }
+    if ( count ) {
+        (*count)++;
+    }
+    heap[size].deadline = deadline;
+    heap[size].sequence = sequence;
+    heap[size].step     = step;
+    heap[size].slot     = slot;
+    siftUp(size++);
+    return true;
+}
+
+bool schedulerAdd( time_t deadline, int sequence, int step ) {
+    return schedulerAddTimer(deadline, sequence, step, NULL);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Remove all steps of a sequence, then restore heap order
+ * ----------------------------------------------------------------------------------- */
+void schedulerCancel( int sequence ) {
+    int kept = 0;
+    for ( int idx=0; idx<size; idx++ ) {
+        if ( heap[idx].sequence != sequence ) {
+            place(kept++, heap[idx]);
+        } else if ( heap[idx].slot ) {
+            *heap[idx].slot = -1;
+        }
+    }
+    size = kept;
+    int *count = pendingCount(sequence, false);
+    if ( count ) {
+        *count = 0;
+    }
+    for ( int idx=size/2-1; idx>=0; idx-- ) {
+        siftDown(idx);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Remove the entry added with this slot, if it is still pending. The last entry
+ * takes its place and is moved up or down from there.
+ * ----------------------------------------------------------------------------------- */
+void schedulerCancelTimer( int *slot ) {
+    int idx = *slot;
+    if ( idx < 0 || idx >= size || heap[idx].slot != slot ) {
+        return;
+    }
+    int *count = pendingCount(heap[idx].sequence, false);
+    if ( count ) {
+        (*count)--;
+    }
+    *slot = -1;
+    if ( idx == --size ) {
+        return;
+    }
+    place(idx, heap[size]);
+    if ( idx > 0 && before(&heap[idx], &heap[(idx-1)/2]) ) {
+        siftUp(idx);
+    } else {
+        siftDown(idx);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Check if there are steps left for a sequence
+ * ----------------------------------------------------------------------------------- */
+bool schedulerPending( int sequence ) {
+    int *count = pendingCount(sequence, false);
+    return count && *count > 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Earliest deadline, 0 if nothing is scheduled
+ * ----------------------------------------------------------------------------------- */
+time_t schedulerNextDeadline( void ) {
+    return size ? heap[0].deadline : 0;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Fire all steps that are due, return number of steps fired
+ * ----------------------------------------------------------------------------------- */
+int schedulerRun( time_t now, schedCallback_t fire ) {
+    int fired = 0;
+    while ( size && heap[0].deadline <= now ) {
+        schedEntry_t entry = heap[0];
+        if ( entry.slot ) {
+            *entry.slot = -1;
+        }
+        if ( --size ) {
+            place(0, heap[size]);
+            siftDown(0);
+        }
+        int *count = pendingCount(entry.sequence, false);
+        if ( count ) {
+            (*count)--;
+        }
+        (*fire)(entry.sequence, entry.step);
+        fired++;
+    }
+    return fired;
+}
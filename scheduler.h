@@ -0,0 +1,50 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+#include <time.h>
+
+#ifndef scheduler_h
+#define scheduler_h
+
+/* ----------------------------------------------------------------------------------- *
+ * A pending sequence step, kept in a min-heap ordered by deadline
+ * ----------------------------------------------------------------------------------- */
+typedef struct schedEntry_t {
+    time_t deadline;             // clockMono() time the step is due
+    int    sequence;             // sequence the step belongs to
+    int    step;                 // index of step in sequence
+    int   *slot;                 // kept up to date with the heap index, NULL if unused
+} schedEntry_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Called for each step that is due
+ * ----------------------------------------------------------------------------------- */
+typedef void (*schedCallback_t)(int sequence, int step);
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+bool   schedulerAdd(time_t deadline, int sequence, int step);  // queue step, O(log n)
+void   schedulerCancel(int sequence);                          // drop steps of sequence
+bool   schedulerAddTimer(time_t deadline, int sequence, int step, int *slot);
+void   schedulerCancelTimer(int *slot);                        // drop it again, O(log n)
+bool   schedulerPending(int sequence);                         // any steps left? O(1)
+time_t schedulerNextDeadline(void);                            // earliest deadline or 0
+int    schedulerRun(time_t now, schedCallback_t fire);         // fire all due steps
+
+#endif /* scheduler_h */
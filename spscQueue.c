@@ -0,0 +1,77 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdlib.h>
+
+#include "spscQueue.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Allocate slots, capacity has to be a power of two
+ * ----------------------------------------------------------------------------------- */
+bool spscInit( spscQueue_t *queue, size_t capacity, size_t slotSize ) {
+    if ( capacity == 0 || (capacity & (capacity-1)) ) {
+        return false;
+    }
+    queue->slots = calloc(capacity, slotSize);
+    if ( !queue->slots ) {
+        return false;
+    }
+    queue->slotSize = slotSize;
+    queue->mask     = capacity-1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return true;
+}
+
+void spscFree( spscQueue_t *queue ) {
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Producer side
+ * ----------------------------------------------------------------------------------- */
+void *spscWriteSlot( spscQueue_t *queue ) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if ( tail - head > queue->mask ) {
+        return NULL;                             // full
+    }
+    return queue->slots + (tail & queue->mask) * queue->slotSize;
+}
+
+void spscCommit( spscQueue_t *queue ) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail, tail+1, memory_order_release);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Consumer side
+ * ----------------------------------------------------------------------------------- */
+void *spscReadSlot( spscQueue_t *queue ) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if ( head == tail ) {
+        return NULL;                             // empty
+    }
+    return queue->slots + (head & queue->mask) * queue->slotSize;
+}
+
+void spscRelease( spscQueue_t *queue ) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, head+1, memory_order_release);
+}
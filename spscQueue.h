@@ -0,0 +1,53 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifndef spscQueue_h
+#define spscQueue_h
+
+/* ----------------------------------------------------------------------------------- *
+ * Bounded lock free queue for exactly one producer and one consumer thread
+ *
+ * Slots have a fixed size and are filled and read in place: the producer gets a free
+ * slot with spscWriteSlot, fills it and publishes it with spscCommit. The consumer
+ * gets the oldest slot with spscReadSlot and hands it back with spscRelease. Head and
+ * tail are free running counters, each written by one side only, and live in
+ * separate cache lines.
+ * ----------------------------------------------------------------------------------- */
+typedef struct spscQueue_t {
+    _Alignas(64) atomic_size_t head;    // next slot to read, written by consumer
+    _Alignas(64) atomic_size_t tail;    // next slot to write, written by producer
+    _Alignas(64) char  *slots;          // capacity * slotSize bytes
+    size_t              slotSize;       // size of one slot
+    size_t              mask;           // capacity-1, capacity is a power of two
+} spscQueue_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+bool  spscInit(spscQueue_t *queue, size_t capacity, size_t slotSize);  // capacity: 2^n
+void  spscFree(spscQueue_t *queue);
+
+void *spscWriteSlot(spscQueue_t *queue);     // producer: free slot or NULL if full
+void  spscCommit(spscQueue_t *queue);        // producer: publish slot
+void *spscReadSlot(spscQueue_t *queue);      // consumer: oldest slot or NULL if empty
+void  spscRelease(spscQueue_t *queue);       // consumer: hand slot back
+
+#endif /* spscQueue_h */
@@ -0,0 +1,155 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yardControl.h"
+#include "readConfig.h"
+#include "journal.h"
+#include "persistState.h"
+#include "scheduler.h"
+#include "clockSource.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Entry points of yardControl.c, linked without main()
+ * ----------------------------------------------------------------------------------- */
+bool setupButtons(void);
+void setupIO(void);
+void activateSequence(int idx);
+void startSequence(pushbutton_t *button);
+void resumeSequence(const journal_t *journal, time_t now);
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                        \
+    do {                                                                         \
+        if ( !(cond) ) {                                                         \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                          \
+            printf(__VA_ARGS__);                                                 \
+            printf("\n");                                                        \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static pushbutton_t *button( const char *name ) {
+    for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
+        if ( !strcmp(pushButtons[btnIndex].name, name) ) {
+            return &pushButtons[btnIndex];
+        }
+    }
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Restart <minutes> after the sequence started, with valve A switched on (step 0)
+ * and not yet off again. A has to be open and closed <remaining> seconds from now.
+ * ----------------------------------------------------------------------------------- */
+static void restartWithValveOpen( int policy, int minutes, int remaining ) {
+    journal_t journal = { true, 1, clockWall() - minutes*60, 0 };
+
+    resumePolicy = policy;
+    resumeSequence(&journal, clockWall());
+
+    CHECK(button("A")->state, "policy %d: valve A not reopened", policy);
+    CHECK(!button("B")->state, "policy %d: valve B opened", policy);
+    CHECK(schedulerNextDeadline() - clockMono() == remaining,
+          "policy %d: A closes after %ld s, expected %d s", policy,
+          (long)(schedulerNextDeadline() - clockMono()), remaining);
+
+    // stop sequence, all valves off
+    button("R")->state = false;
+    startSequence(button("R"));
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Ids of SEQUENCE are any int, the journal must not mix up 65537 with 1
+ * ----------------------------------------------------------------------------------- */
+static void resumeLargeId( void ) {
+    journal_t journal;
+
+    activateSequence(1);                         // SEQUENCE 65537
+    button("R")->state = true;
+    startSequence(button("R"));
+    CHECK(journalRead(&journal) && journal.sequence == 65537,
+          "journal has sequence %d, expected 65537", journal.sequence);
+    button("R")->state = false;
+    startSequence(button("R"));
+
+    activateSequence(0);                         // SEQUENCE 1, not the one interrupted
+    resumeSequence(&journal, clockWall());
+    CHECK(schedulerNextDeadline() == 0, "sequence 1 resumed for 65537");
+
+    activateSequence(1);
+    resumeSequence(&journal, clockWall());
+    CHECK(schedulerNextDeadline() != 0, "sequence 65537 not resumed");
+    button("R")->state = false;
+    startSequence(button("R"));
+}
+
+int main( void ) {
+    char  dir[] = "/tmp/yardControl_testXXXXXX";
+    char  fileName[64];
+    FILE *fp;
+
+    if ( !mkdtemp(dir) ) {
+        printf("can't create %s\n", dir);
+        return 1;
+    }
+    snprintf(fileName, sizeof(fileName), "%s/test.cfg", dir);
+    if ( !(fp = fopen(fileName, "w")) ) {
+        printf("can't create %s\n", fileName);
+        return 1;
+    }
+    fprintf(fp, "STATEDIR %s\nASYNCLOG 0\nSEQUENCE 1\n  VALVE A 10\n  VALVE B 5\n"
+                "SEQUENCE 65537\n  VALVE A 10\n  VALVE B 5\n", dir);
+    fclose(fp);
+
+    initLog(false);
+    setLogLevel(LOG_WARNING);
+    configFile = fileName;
+    readConfig();
+    if ( !config || !setupButtons() ) {
+        return 1;
+    }
+    clockSetVirtual(clockWall());
+    setupIO();
+    activateSequence(0);
+
+    // original timing: 3 of A's 10 minutes were done before the restart
+    restartWithValveOpen(RESUME_OFFSET, 3, 7*60);
+
+    // shifted timing: A gets its 10 minutes again, not closed right away
+    restartWithValveOpen(RESUME_STEP, 30, 10*60);
+
+    resumeLargeId();
+
+    char path[128];
+    commitState();                               // nothing left to write at exit
+    snprintf(path, sizeof(path), "%s/" JOURNAL_FILE, dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/" STATE_FILE, dir);
+    unlink(path);
+    unlink(fileName);
+    rmdir(dir);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "trace.h"
+#include "clockSource.h"
+#include "logging.h"
+
+/* ----------------------------------------------------------------------------------- *
+ * Recording: records go through a stdio buffer, flushed once per loop
+ * ----------------------------------------------------------------------------------- */
+static FILE   *out       = NULL;
+static time_t  startMono = 0;
+static time_t  startWall = 0;
+static bool    pending   = false;            // records not flushed yet
+
+/* ----------------------------------------------------------------------------------- *
+ * Replay: the whole trace is mapped
+ * ----------------------------------------------------------------------------------- */
+static const char *trace     = NULL;
+static size_t      traceSize = 0;
+static size_t      tracePos  = 0;
+
+/* ----------------------------------------------------------------------------------- *
+ * Create trace file, recording starts now
+ * ----------------------------------------------------------------------------------- */
+bool traceOpen( const char *fileName, int numButtons ) {
+    traceHeader_t header;
+
+    out = fopen(fileName, "w");
+    if ( !out ) {
+        writeLog(LOG_ERR, "Error: can't create trace %s [%s]", fileName, strerror(errno));
+        return false;
+    }
+    startMono = clockMono();
+    startWall = clockWall();
+
+    memset(&header, 0, sizeof(header));
+    header.magic      = TRACE_MAGIC;
+    header.version    = TRACE_VERSION;
+    header.numButtons = numButtons;
+    header.wall       = startWall;
+    fwrite(&header, sizeof(header), 1, out);
+    pending = true;
+    writeLog(LOG_NOTICE, "Recording trace to %s", fileName);
+    return true;
+}
+
+static void record( int type, int index, int value, const char *topic, int topicLen,
+                    const char *payload, int payloadLen ) {
+    traceRecord_t rec;
+
+    rec.type       = type;
+    rec.value      = value;
+    rec.index      = index;
+    rec.topicLen   = topicLen;
+    rec.payloadLen = payloadLen;
+    rec.mono       = (uint32_t)(clockMono() - startMono);
+    rec.wall       = (int32_t)(clockWall() - startWall);
+    fwrite(&rec, sizeof(rec), 1, out);
+    if ( topicLen ) {
+        fwrite(topic, topicLen, 1, out);
+    }
+    if ( payloadLen ) {
+        fwrite(payload, payloadLen, 1, out);
+    }
+    pending = true;
+}
+
+void traceStart( int sequence, int mode ) {
+    if ( out ) {
+        record(TRACE_START, sequence, mode, NULL, 0, NULL, 0);
+    }
+}
+
+void traceButton( int index, int level ) {
+    if ( out ) {
+        record(TRACE_BUTTON, index, level, NULL, 0, NULL, 0);
+    }
+}
+
+void traceMessage( const char *topic, const char *payload, int payloadlen ) {
+    if ( out ) {
+        record(TRACE_MQTT, 0, 0, topic, (int)strlen(topic), payload, payloadlen);
+    }
+}
+
+void traceTick( int events ) {
+    if ( out ) {
+        record(TRACE_TICK, 0, events, NULL, 0, NULL, 0);
+    }
+}
+
+void traceFlush( void ) {
+    if ( out && pending ) {
+        fflush(out);
+        pending = false;
+    }
+}
+
+void traceClose( void ) {
+    if ( out ) {
+        fclose(out);
+        out = NULL;
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Map trace for replay and check its header
+ * ----------------------------------------------------------------------------------- */
+bool traceLoad( const char *fileName, traceHeader_t *header ) {
+    struct stat st;
+    int fd = open(fileName, O_RDONLY);
+
+    if ( fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(traceHeader_t) ) {
+        writeLog(LOG_ERR, "Error: can't read trace %s", fileName);
+        if ( fd >= 0 ) close(fd);
+        return false;
+    }
+    traceSize = st.st_size;
+    trace     = mmap(NULL, traceSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( trace == MAP_FAILED ) {
+        writeLog(LOG_ERR, "Error: can't map trace %s [%s]", fileName, strerror(errno));
+        trace = NULL;
+        return false;
+    }
+    memcpy(header, trace, sizeof(traceHeader_t));
+    if ( header->magic != TRACE_MAGIC || header->version != TRACE_VERSION ) {
+        writeLog(LOG_ERR, "Error: %s is no trace or of a different version", fileName);
+        traceUnload();
+        return false;
+    }
+    tracePos = sizeof(traceHeader_t);
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Next record of mapped trace, a record cut off at the end is dropped
+ * ----------------------------------------------------------------------------------- */
+bool traceNext( traceEvent_t *event ) {
+    if ( !trace || tracePos + sizeof(traceRecord_t) > traceSize ) {
+        return false;
+    }
+    memcpy(&event->record, trace + tracePos, sizeof(traceRecord_t));
+    size_t data = (size_t)event->record.topicLen + event->record.payloadLen;
+    if ( tracePos + sizeof(traceRecord_t) + data > traceSize ) {
+        return false;
+    }
+    event->topic   = trace + tracePos + sizeof(traceRecord_t);
+    event->payload = event->topic + event->record.topicLen;
+    tracePos += sizeof(traceRecord_t) + data;
+    return true;
+}
+
+void traceUnload( void ) {
+    if ( trace ) {
+        munmap((void*)trace, traceSize);
+        trace = NULL;
+    }
+}
@@ -0,0 +1,79 @@
+/* *********************************************************************************** */
+/*                                                                                     */
+/*  Copyright (c) 2018 by Bodo Bauer <bb@bb-zone.com>                                  */
+/*                                                                                     */
+/*  This program is free software: you can redistribute it and/or modify               */
+/*  it under the terms of the GNU General Public License as published by               */
+/*  the Free Software Foundation, either version 3 of the License, or                  */
+/*  (at your option) any later version.                                                */
+/*                                                                                     */
+/*  This program is distributed in the hope that it will be useful,                    */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of                     */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                      */
+/*  GNU General Public License for more details.                                       */
+/*                                                                                     */
+/*  You should have received a copy of the GNU General Public License                  */
+/*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
+/* *********************************************************************************** */
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef trace_h
+#define trace_h
+
+/* ----------------------------------------------------------------------------------- *
+ * Trace of everything that drives the control loop: button edges, MQTT commands and
+ * the timer events of the loop, each with the time it happened. Replayed on the
+ * virtual clock and the simulated IO extender it takes the same code paths again.
+ * ----------------------------------------------------------------------------------- */
+#define TRACE_MAGIC    0x52544359            // "YCTR"
+#define TRACE_VERSION  1
+
+#define TRACE_START    1                     // index: active sequence, value: system mode
+#define TRACE_BUTTON   2                     // index: button, value: debounced level
+#define TRACE_MQTT     3                     // topic and payload follow the record
+#define TRACE_TICK     4                     // value: EV_STEP and/or EV_DEADLINE
+
+typedef struct traceHeader_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t numButtons;                     // replay needs the same buttons
+    int64_t  wall;                           // wall clock at start of trace
+} traceHeader_t;
+
+typedef struct traceRecord_t {
+    uint8_t  type;                           // TRACE_*
+    uint8_t  value;
+    uint16_t index;
+    uint16_t topicLen;                       // TRACE_MQTT: bytes of topic and payload
+    uint16_t payloadLen;                     // following, neither is zero terminated
+    uint32_t mono;                           // seconds since start of trace
+    int32_t  wall;                           // wall clock relative to header
+} traceRecord_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * A record read back, strings point into the mapped trace
+ * ----------------------------------------------------------------------------------- */
+typedef struct traceEvent_t {
+    traceRecord_t record;
+    const char   *topic;
+    const char   *payload;
+} traceEvent_t;
+
+/* ----------------------------------------------------------------------------------- *
+ * Prototypes
+ * ----------------------------------------------------------------------------------- */
+bool traceOpen(const char *fileName, int numButtons);   // start recording
+void traceStart(int sequence, int mode);                // state recording starts from
+void traceButton(int index, int level);                 // button edge
+void traceMessage(const char *topic, const char *payload, int payloadlen);
+void traceTick(int events);                             // timer events of the loop
+void traceFlush(void);                                  // write buffered records
+void traceClose(void);
+
+bool traceLoad(const char *fileName, traceHeader_t *header);  // map trace for replay
+bool traceNext(traceEvent_t *event);                    // next record, false at end
+void traceUnload(void);
+
+#endif /* trace_h */
@@ -24,35 +24,68 @@
 #include <syslog.h>
 #include <stdarg.h>
 #include <time.h>
-
-#include <wiringPi.h>
-#include <mcp23017.h>
+#include <signal.h>
 
 #include "yardControl.h"
+#include "hardware.h"
 #include "pushButton.h"
 #include "readConfig.h"
 #include "logging.h"
 #include "daemon.h"
 #include "mqttGateway.h"
 #include "persistState.h"
+#include "eventLoop.h"
+#include "scheduler.h"
+#include "calendar.h"
+#include "publisher.h"
+#include "jsonCommand.h"
+#include "journal.h"
+#include "optimizer.h"
+#include "clockSource.h"
+#include "trace.h"
 
 /* ----------------------------------------------------------------------------------- *
  * Some globals we can't do without... ;)
  * ----------------------------------------------------------------------------------- */
 int    debug              = DEBUG;             // debug level
-int    activeSequence     = 0;                 // sequence to run
+int    activeSequence     = 0;                 // index of program to run
 bool   foreground         = false;             // run in foreground, not as daemon
 int    sequenceInProgress = false;             // sequence in progress
-time_t sequenceStartTime;                      // time sequence was started
+config_t *sequenceConfig  = NULL;              // config the running sequence was started with
+int    runningSequence    = 0;                 // index of running program in sequenceConfig
+time_t sequenceStartTime;                      // wall time sequence was started, for the journal
+time_t sequenceStartMono;                      // clockMono() time steps are scheduled from
+time_t nextStart          = 0;                 // next automatic start of active sequence
 int    systemMode         = MANUAL_MODE;       // System modes
+#if defined(HAVE_WIRINGPI) && !defined(YARDCONTROL_BENCH)
+const hwBackend_t *hwBackend = &hwWiringPi;    // talk to IO extender via wiringPi
+#else
+const hwBackend_t *hwBackend = &hwSimulator;   // no wiringPi, simulate IO extender
+#endif
 
 /* ----------------------------------------------------------------------------------- *
  * Prototypes
  * ----------------------------------------------------------------------------------- */
 int  main(int rgc, char *argv[]);
 void lockValveControl(bool on);
+program_t *activeProgram(void);
+void activateSequence(int idx);
 void processSequence(void);
-void setup(void);
+void processStep(int sequenceIdx, int step);
+void runSequence(time_t startTime, int firstStep);
+void resumeSequence(const journal_t *journal, time_t now);
+void releaseSequenceConfig(void);
+void reloadSequences(void);
+void updateStartTime(time_t now);
+void checkStartTime(time_t now);
+time_t nextDeadline(time_t now);
+void checkClock(time_t now);
+void houseKeeping(void);
+void setupIO(void);
+void simulate(int days);
+void replay(const char *fileName);
+mqttIncoming_t *commandSubscriptions(void);
+bool setupButtons(void);
 
 // Bush button actions
 void setLed(pushbutton_t *button);
@@ -62,112 +95,196 @@ void selectSequence(pushbutton_t *button);
 void automaticMode(pushbutton_t *button);
 
 // MQTT interface
-void pressButtonCB(char *payload, int payloadlen, char *topic, void *button);
-void publishStatus(pushbutton_t *button);
+void pressButtonCB(char *payload, int payloadlen, char *topic, void *buttonList);
+pushbutton_t *buttonByTopic(const char *topic);
 
 /* ----------------------------------------------------------------------------------- *
- * Definition of the pushbuttons
+ * Definition of the pushbuttons, the control buttons are followed by one button
+ * per configured zone
  * ----------------------------------------------------------------------------------- */
-pushbutton_t pushButtons[] = {
-    // name, Button Pin, Led Pin, state, last reading, locked, radio group
-    
-    // Manual valves control, only one shall be active
-    {'A', BUTTON_A,      VALVE_A,  false, -1, false, RG_VALVES,   &switchValve},
-    {'B', BUTTON_B,      VALVE_B,  false, -1, false, RG_VALVES,   &switchValve},
-    {'C', BUTTON_C,      VALVE_C,  false, -1, false, RG_VALVES,   &switchValve},
-    {'D', BUTTON_D,      VALVE_D,  false, -1, false, RG_VALVES,   &switchValve},
+static const pushbutton_t controlButtons[] = {
+    // name, Button Pin, Led Pin, state, last reading, locked, radio group, callback, timer slot
 
     // select active program sequence
-    {'S', BUTTON_SELECT, LED_S0,   false, -1, false, RG_NONE,     &selectSequence},
+    {"S", BUTTON_SELECT, LED_S0,   false, -1, false, RG_NONE,     &selectSequence, -1},
 
     // run active program sequence
-    {'R', BUTTON_RUN,    LED_RUN,  false, -1, false, RG_NONE,     &startSequence},
+    {"R", BUTTON_RUN,    LED_RUN,  false, -1, false, RG_NONE,     &startSequence,  -1},
 
     // toggle timer mode
-    {'P', BUTTON_AUTO,   LED_AUTO, false, -1, false, RG_NONE,     &automaticMode},
-    
-    // end marker
-    {'0', -1, -1, false, -1, false, -1},
+    {"P", BUTTON_AUTO,   LED_AUTO, false, -1, false, RG_NONE,     &automaticMode,  -1},
 };
-#define BUTTON_IDX_SELECT 4
-#define BUTTON_IDX_RUN    5
-#define BUTTON_IDX_TIMER  6
+pushbutton_t *pushButtons = NULL;              // all buttons
+int           numButtons  = 0;
+static pushbutton_t **buttonIndex = NULL;      // hash table: name -> button
+static unsigned       indexMask   = 0;         // size of buttonIndex - 1
+
+#define MANUAL_TIMER     -1      // scheduler 'sequence' for valves switched on with duration
+
+#define BUTTON_IDX_SELECT 0
+#define BUTTON_IDX_RUN    1
+#define BUTTON_IDX_TIMER  2
+#define BUTTON_IDX_ZONE   3      // first zone
+
+/* ----------------------------------------------------------------------------------- *
+ * FNV-1a hash of button name
+ * ----------------------------------------------------------------------------------- */
+static unsigned nameHash( const char *name ) {
+    unsigned hash = 2166136261u;
+    while ( *name ) {
+        hash = (hash ^ (unsigned char)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Create buttons for control buttons and zones
+ * ----------------------------------------------------------------------------------- */
+bool setupButtons( void ) {
+    numButtons  = BUTTON_IDX_ZONE + config->numZones;
+    pushButtons = calloc(numButtons, sizeof(pushbutton_t));
+    if ( !pushButtons ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        return false;
+    }
+    memcpy(pushButtons, controlButtons, sizeof(controlButtons));
+
+    // Manual valves control, only one shall be active
+    for ( int idx=0; idx<config->numZones; idx++ ) {
+        pushbutton_t *button = &pushButtons[BUTTON_IDX_ZONE+idx];
+        button->name        = config->zones[idx].name;
+        button->btnPin      = config->zones[idx].buttonPin;
+        button->ledPin      = config->zones[idx].valvePin;
+        button->lastReading = -1;
+        button->radioGroup  = RG_VALVES;
+        button->callback    = &switchValve;
+        button->timerSlot   = -1;
+    }
+
+    // index for MQTT commands, at most half full
+    unsigned size = 8;
+    while ( size < 2u*numButtons ) {
+        size *= 2;
+    }
+    buttonIndex = calloc(size, sizeof(pushbutton_t*));
+    if ( !buttonIndex ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        return false;
+    }
+    indexMask = size-1;
+    for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
+        unsigned slot = nameHash(pushButtons[btnIndex].name) & indexMask;
+        while ( buttonIndex[slot] ) {
+            slot = (slot+1) & indexMask;
+        }
+        buttonIndex[slot] = &pushButtons[btnIndex];
+    }
+    return true;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Program selected to run, NULL if none is configured
+ * ----------------------------------------------------------------------------------- */
+program_t *activeProgram( void ) {
+    return config->numPrograms > 0 ? &config->programs[activeSequence] : NULL;
+}
 
 /* ----------------------------------------------------------------------------------- *
  * Enable/Disable manual valve control (radio group: RG_VALVES)
  * ----------------------------------------------------------------------------------- */
 void lockValveControl (bool on ) {
-    int btnIndex = 0;
     if ( !on ) {
         writeLog(LOG_INFO, "Lock manual valve control");
         // disable manual valve control
-        while ( pushButtons[btnIndex].btnPin >= 0 ) {
+        for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
             if (pushButtons[btnIndex].radioGroup == RG_VALVES) {
                 pushbutton_t *btnValve = &pushButtons[btnIndex];
                 btnValve->locked = true;
                 btnValve->state  = false;
                 switchValve( btnValve );
             }
-            btnIndex++;
         }
     } else {
         writeLog(LOG_INFO, "Unlock manual valve control");
         // enable manual valve control
-        while ( pushButtons[btnIndex].btnPin >= 0 ) {
+        for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
             if (pushButtons[btnIndex].radioGroup == RG_VALVES) {
                 pushButtons[btnIndex].locked = false;
             }
-            btnIndex++;
         }
     }
 }
 
-/* ----------------------------------------------------------------------------------- *
- * Publish button status
- * ----------------------------------------------------------------------------------- */
-void publishStatus(pushbutton_t *button) {
-    char topic[strlen(mqttBroker.prefix)+12], message[32];
-    sprintf(message, "{\"state\":\"%s\"}", button->state ? "ON" : "OFF");
-    sprintf(topic,   "%s/Valve_%c", mqttBroker.prefix, button->name);
-    mqttPublish(topic, message);
-}
-
 /* ----------------------------------------------------------------------------------- *
  * Switch Valve
  * ----------------------------------------------------------------------------------- */
 void switchValve( pushbutton_t *button ) {
-    writeLog ( LOG_INFO, "Turn valve %c %s", button->name, button->state? "ON":"OFF" );
+    writeLog ( LOG_INFO, "Turn valve %s %s", button->name, button->state? "ON":"OFF" );
+    // any change overrides a pending automatic switch off
+    if ( button->timerSlot >= 0 ) {
+        schedulerCancelTimer(&button->timerSlot);
+    }
     // led is conntected to valve
     setLed( button );
     publishStatus(button);
 }
 
+/* ----------------------------------------------------------------------------------- *
+ * Find button addressed by the last level of a command topic (.../Valve_<name>)
+ * ----------------------------------------------------------------------------------- */
+pushbutton_t *buttonByTopic(const char *topic) {
+    const char *level = strrchr(topic, '/');
+    level = level ? level+1 : topic;
+    if ( !strncmp(level, "Valve_", 6) && buttonIndex ) {
+        unsigned slot = nameHash(level+6) & indexMask;
+        while ( buttonIndex[slot] ) {
+            if ( !strcmp(level+6, buttonIndex[slot]->name) ) {
+                return buttonIndex[slot];
+            }
+            slot = (slot+1) & indexMask;
+        }
+    }
+    return NULL;
+}
+
 /* ----------------------------------------------------------------------------------- *
  * Switch Valve with MQTT command
+ *
+ * Payload: {"state":"ON", "duration":<minutes>, "id":"<request id>"}, see jsonCommand.h
  * ----------------------------------------------------------------------------------- */
 void pressButtonCB(char *payload, int payloadlen, char *topic, void *user_data) {
-    pushbutton_t *button = (pushbutton_t*)user_data;
+    pushbutton_t *button = buttonByTopic(topic);
+    command_t     command;
+
     // writeLog(LOG_INFO, "Received MQTT message: %s: %s", topic, payload);
-    if (button->locked) {             // Do not allow changes of locked buttons over MQTT
-        // writeLog(LOG_INFO, "Button %c locked!", button->name);
-        publishStatus(button);
+    if (!button) {
+        writeLog(LOG_ERR, "Received MQTT message for unknown button: %s", topic);
+    } else if (!parseCommand(payload, payloadlen, &command)) {
+        writeLog(LOG_ERR, "Received unknown MQTT message: %.*s", payloadlen, payload);
+    } else if (button->locked) {             // Do not allow changes of locked buttons over MQTT
+        // writeLog(LOG_INFO, "Button %s locked!", button->name);
+        republishStatus(button);
     } else {
         bool oldState = button->state;
-        if (!strncmp(payload, "{\"state\":\"ON\"}", payloadlen) || !strncmp(payload, "{\"state\":\"1\"}", payloadlen)){
-            button->state = true;
-        } else if (!strncmp(payload, "{\"state\":\"OFF\"}", payloadlen) || !strncmp(payload, "{\"state\":\"0\"}", payloadlen)){
-            button->state = false;
-        } else {
-            writeLog(LOG_ERR, "Received unknown MQTT message: %s", payload);
+        if (command.idLen) {
+            writeLog(LOG_INFO, "Request %.*s: %s %s", command.idLen, command.id,
+                     button->name, command.state == CMD_ON ? "ON" : "OFF");
         }
+        button->state = (command.state == CMD_ON);
         if (button->state != oldState) {
             // if a radio group has been defined clear state of all buttons in this group
-            processRadioGroup( button, pushButtons);
+            processRadioGroup( button, pushButtons, numButtons);
             // call button action
             if (button->callback) {
                 (button->callback)(button);
             }
         }
+        // valves may be switched on for a limited time only
+        if (button->state && command.duration > 0 && button->radioGroup == RG_VALVES) {
+            schedulerCancelTimer(&button->timerSlot);
+            schedulerAddTimer(clockMono() + command.duration*60, MANUAL_TIMER, (int)(button - pushButtons),
+                              &button->timerSlot);
+        }
     }
 }
 
@@ -175,6 +292,7 @@ void pressButtonCB(char *payload, int payloadlen, char *topic, void *user_data)
  * start sequence
  * ----------------------------------------------------------------------------------- */
 void startSequence( pushbutton_t *button ) {
+    program_t *program = activeProgram();
     setLed(button);
     publishStatus(button);
 
@@ -183,44 +301,192 @@ void startSequence( pushbutton_t *button ) {
         lockValveControl(!button->state);
     
         // enable/disable sequence change
-        pushButtons[4].locked = button->state;
+        pushButtons[BUTTON_IDX_SELECT].locked = button->state;
     }
     
-    if ( button->state && sequence[activeSequence][0].offset >=0 ) {
-        writeLog(LOG_INFO, "Start sequence %02d", activeSequence);
-        sequenceInProgress = true;            // start sequence
-        int step = 0;
-        while ( sequence[activeSequence][step].offset >= 0 ) {
-            sequence[activeSequence][step].done = false;
-            step++;
-        }
-        sequenceStartTime = time(NULL);
+    if ( button->state && program && program->numSteps > 0 ) {
+        writeLog(LOG_INFO, "Start sequence %02d", program->id);
+        runSequence(clockWall(), 0);
     } else {
-        writeLog(LOG_INFO, "Stop sequence %02d", activeSequence);
+        if ( sequenceInProgress ) {
+            writeLog(LOG_INFO, "Stop sequence %02d", sequenceConfig->programs[runningSequence].id);
+            schedulerCancel(runningSequence); // drop steps not done yet
+            journalEnd();                     // nothing to resume
+            releaseSequenceConfig();
+        }
         sequenceInProgress = false;           // stop sequence processing
         // switch all valves off
-        int btnIndex = 0;
-        while ( pushButtons[btnIndex].btnPin >= 0 ) {
+        for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
             if (pushButtons[btnIndex].radioGroup == RG_VALVES) {
                 pushbutton_t *btnValve = &pushButtons[btnIndex];
                 btnValve->state  = false;
                 switchValve( btnValve );
             }
-            btnIndex++;
         }
     }
 }
 
 /* ----------------------------------------------------------------------------------- *
- * Select sequence to run
+ * Schedule steps of active sequence, steps before firstStep count as done. The start
+ * is given in wall time, steps are scheduled on the monotonic clock so setting the
+ * wall clock doesn't stretch or skip them.
+ * ----------------------------------------------------------------------------------- */
+void runSequence( time_t startTime, int firstStep ) {
+    program_t *program = activeProgram();
+    if ( sequenceInProgress ) {
+        schedulerCancel(runningSequence); // a restart replaces pending steps
+        releaseSequenceConfig();
+    }
+    sequenceInProgress = true;            // start sequence
+    sequenceStartTime  = startTime;
+    sequenceStartMono  = clockMono() - (clockWall() - startTime);
+    sequenceConfig     = config;          // a reload doesn't affect the running sequence
+    runningSequence    = activeSequence;
+    for ( int step=0; step<program->numSteps; step++ ) {
+        program->steps[step].done = (step < firstStep);
+        if ( step >= firstStep ) {
+            schedulerAdd(sequenceStartMono + program->steps[step].offset, runningSequence, step);
+        }
+    }
+    journalStart(program->id, sequenceStartTime);
+    if ( firstStep > 0 ) {
+        journalStep(firstStep-1);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Free the config of a finished sequence if it has been replaced in the meantime
+ * ----------------------------------------------------------------------------------- */
+void releaseSequenceConfig( void ) {
+    if ( sequenceConfig && sequenceConfig != config ) {
+        writeLog(LOG_DEBUG, "Release config replaced while sequence was running");
+        free(sequenceConfig);
+    }
+    sequenceConfig = NULL;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Read config file again on SIGHUP. Config is only used by the main loop, so the new
+ * one takes over between two iterations. The selected sequence is kept if it still
+ * exists; a running sequence ends with the config it was started with.
+ * ----------------------------------------------------------------------------------- */
+void reloadSequences( void ) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    program_t *selected   = activeProgram();
+    int        selectedId = selected ? selected->id : -1;
+    config_t  *fresh      = reloadConfig();
+    if ( fresh ) {
+        config_t *old = config;
+        config = fresh;
+        // zones haven't changed, but their names now live in the new config
+        for ( int idx=0; idx<config->numZones; idx++ ) {
+            pushButtons[BUTTON_IDX_ZONE+idx].name = config->zones[idx].name;
+        }
+        if ( old != sequenceConfig ) {
+            free(old);                    // else freed once the sequence is over
+        }
+        program_t *program = findProgram(selectedId);
+        activateSequence( program ? (int)(program - config->programs) : 0 );
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long usec = (end.tv_sec - start.tv_sec)*1000000L + (end.tv_nsec - start.tv_nsec)/1000;
+    if ( fresh ) {
+        writeLog(LOG_NOTICE, "Reloaded %s in %ld us: %d zones, %d sequences%s", configFile, usec,
+                 config->numZones, config->numPrograms,
+                 sequenceConfig ? ", running sequence continues unchanged" : "");
+    } else {
+        writeLog(LOG_NOTICE, "Reload of %s rejected after %ld us, keeping current config", configFile, usec);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Continue a sequence interrupted by a restart, according to the RESUME policy:
+ *   RESUME_OFFSET  keep the original time line, steps that are overdue run at once
+ *   RESUME_STEP    continue with the first step not done, remaining steps keep
+ *                  their full duration
+ * ----------------------------------------------------------------------------------- */
+void resumeSequence( const journal_t *journal, time_t now ) {
+    program_t *program  = activeProgram();
+    int        nextStep = journal->lastStep+1;
+
+    if ( !journal->inProgress || resumePolicy == RESUME_OFF ) {
+        return;
+    }
+    if ( !program || journal->sequence != program->id ) {
+        writeLog(LOG_NOTICE, "Interrupted sequence %02d is no longer selected, not resuming", journal->sequence);
+        journalEnd();
+        return;
+    }
+    if ( nextStep >= program->numSteps ) {
+        journalEnd();                     // all steps were done
+        return;
+    }
+
+    // same as pressing the run button, without starting over
+    pushbutton_t *button = &pushButtons[BUTTON_IDX_RUN];
+    button->state = true;
+    setLed(button);
+    publishStatus(button);
+    if ( systemMode == MANUAL_MODE ) {
+        lockValveControl(false);
+        pushButtons[BUTTON_IDX_SELECT].locked = true;
+    }
+
+    // open the valves the steps done so far left open
+    bool valveOpen = false;
+    for ( int step=0; step<nextStep; step++ ) {
+        pushButtons[BUTTON_IDX_ZONE + program->steps[step].valve].state = program->steps[step].state;
+    }
+    for ( int idx=0; idx<config->numZones; idx++ ) {
+        if ( pushButtons[BUTTON_IDX_ZONE+idx].state ) {
+            switchValve(&pushButtons[BUTTON_IDX_ZONE+idx]);
+            valveOpen = true;
+        }
+    }
+
+    // RESUME_STEP: an open valve gets its time again, counted from the last step
+    // done, otherwise the next step is due now
+    time_t startTime = journal->startTime;
+    if ( resumePolicy == RESUME_STEP ) {
+        startTime = now - program->steps[valveOpen ? nextStep-1 : nextStep].offset;
+    }
+    writeLog(LOG_NOTICE, "Resuming sequence %02d at step %d, %d min after its start",
+             program->id, nextStep, (int)(now - startTime)/60);
+    runSequence(startTime, nextStep);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Select sequence to run, each press moves on to the next one
  * ----------------------------------------------------------------------------------- */
 void selectSequence( pushbutton_t *button ) {
-    digitalWrite ( LED_S0, button->state ? LOW : HIGH);
-    digitalWrite ( LED_S1, button->state ? HIGH : LOW);
-    activeSequence = button->state ? 1:0;
-    saveState("sequence", button->state);
+    if ( config->numPrograms > 0 ) {
+        activateSequence( (activeSequence+1) % config->numPrograms );
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Make program with given index the active one. The LEDs show its position
+ * (1, 2, 3) in binary, the button state toggles with each sequence.
+ * ----------------------------------------------------------------------------------- */
+void activateSequence( int idx ) {
+    pushbutton_t *button = &pushButtons[BUTTON_IDX_SELECT];
+    int position = config->numPrograms > 0 ? idx+1 : 0;
+
+    activeSequence = idx;
+    hwDigitalWrite ( LED_S0, (position & 1) ? HIGH : LOW);
+    hwDigitalWrite ( LED_S1, (position & 2) ? HIGH : LOW);
+    button->state = (idx & 1) != 0;
+    updateStartTime(clockWall());
     publishStatus(button);
-    writeLog(LOG_INFO,"Activated Sequence %d", button->state ? 1:0);
+
+    program_t *program = activeProgram();
+    if ( program ) {
+        saveStateInt("sequence", program->id);
+        writeLog(LOG_INFO,"Activated Sequence %d", program->id);
+    }
 }
 
 /* ----------------------------------------------------------------------------------- *
@@ -234,7 +500,7 @@ void automaticMode( pushbutton_t *button ) {
     pushButtons[BUTTON_IDX_RUN].state  = false;
     startSequence( &pushButtons[BUTTON_IDX_RUN] );       // stop sequence in progress
     pushButtons[BUTTON_IDX_RUN].locked = button->state;
-    digitalWrite (LED_RUN, LOW);
+    hwDigitalWrite (LED_RUN, LOW);
 
     // enable/disable sequence change
     pushButtons[BUTTON_IDX_SELECT].locked = button->state;
@@ -244,6 +510,7 @@ void automaticMode( pushbutton_t *button ) {
     
     // set system mode
     systemMode = button->state ? AUTOMATIC_MODE:MANUAL_MODE;
+    updateStartTime(clockWall());
 
     // safe state
     saveState("automatic", button->state);
@@ -255,70 +522,330 @@ void automaticMode( pushbutton_t *button ) {
  * Set LED of push button
  * ----------------------------------------------------------------------------------- */
 void setLed( pushbutton_t *button ) {
-    digitalWrite ( button->ledPin, button->state ? HIGH : LOW);
+    hwDigitalWrite ( button->ledPin, button->state ? HIGH : LOW);
 }
 
 /* ----------------------------------------------------------------------------------- *
- * process active sequence
+ * Execute a single step of a sequence
+ * ----------------------------------------------------------------------------------- */
+void processStep(int sequenceIdx, int step) {
+    if ( sequenceIdx == MANUAL_TIMER ) {         // duration of manually switched valve is over
+        pushButtons[step].state = false;
+        switchValve(&pushButtons[step]);
+        return;
+    }
+
+    sequence_t   *seqStep = &sequenceConfig->programs[sequenceIdx].steps[step];
+    pushbutton_t *valve   = &pushButtons[BUTTON_IDX_ZONE + seqStep->valve];
+
+    seqStep->done = true;                        // mark step as done
+    valve->state  = seqStep->state;              // Valve ON or OFF ?
+    journalStep(step);                           // remember progress
+
+    //writeLog(LOG_INFO, "S%02d(%02d) t+%04d: turn valve %s %s", sequenceIdx, step, seqStep->offset,
+    //         valve->name, seqStep->state? "ON":"OFF");
+
+    switchValve(valve);                          // switch Valve
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * process active sequence and valve timers: execute all steps that are due
  * ----------------------------------------------------------------------------------- */
 void processSequence() {
-    static int lastStep =0;
-    int offset = (int)time(NULL)-sequenceStartTime;
-    if ( !sequence[activeSequence][0].done ) {
-         lastStep = 0;
-    }
-    int step = lastStep;
-
-    while ( sequence[activeSequence][step].offset >= 0 ) {
-        sequence_t *seqStep = &sequence[activeSequence][step];
-        
-        if (seqStep->offset <= offset && !seqStep->done) {
-            seqStep->done = true;                    // mark step as done
-            seqStep->valve->state = seqStep->state;  // Valve ON or OFF ?
-
-            //writeLog(LOG_INFO, "S%02d(%02d) t+%04d: turn valve %c %s", activeSequence, step, offset,
-            //         seqStep->valve->name, seqStep->state? "ON":"OFF");
-
-            switchValve(seqStep->valve);             // switch Valve
-            lastStep = step;                         // remember where we left off
-            break;                                   // we're done here for now
-        } else if (seqStep->offset > offset) {       // skip the future
+    if ( schedulerRun(clockMono(), &processStep) > 0 ) {
+        // end of sequence reached?
+        if ( sequenceInProgress && !schedulerPending(runningSequence) ) {
+            pushButtons[BUTTON_IDX_RUN].state=false;  // simulate sequence button press
+            startSequence( &pushButtons[BUTTON_IDX_RUN] );
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Calculate next automatic start of the active sequence
+ * ----------------------------------------------------------------------------------- */
+void updateStartTime(time_t now) {
+    program_t *program = activeProgram();
+    nextStart = program ? calendarNextStart(program->startTimes, now) : 0;
+    if ( nextStart ) {
+        char timeString[32];
+        strftime(timeString, sizeof(timeString), "%Y-%m-%d %H:%M", localtime(&nextStart));
+        writeLog(LOG_DEBUG, "Next start of sequence %02d at %s", program->id, timeString);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Start active sequence in automatic mode when its start time has come
+ *
+ * A start that is due while a sequence is still running, or that has been missed
+ * because the loop stalled or the clock was stepped, runs late as long as it is
+ * within the catch up window. After that it's dropped.
+ * ----------------------------------------------------------------------------------- */
+void checkStartTime(time_t now) {
+    if ( nextStart && now >= nextStart ) {
+        int id = activeProgram()->id;
+        int late = (int)(now - nextStart);
+        if ( late >= catchUp*60 + 60 ) {
+            writeLog( LOG_NOTICE, "Missed start of sequence %02d by %d min, skipping", id, late/60 );
+            updateStartTime(now);
+        } else if ( !sequenceInProgress ) {
+            if ( late >= 60 ) {
+                writeLog( LOG_NOTICE, "Starting sequence %02d %d min late", id, late/60 );
+            }
+            writeLog( LOG_INFO, "Autostart sequence %02d", id );
+            pushButtons[BUTTON_IDX_RUN].state=true;  // simulate sequence button press
+            startSequence( &pushButtons[BUTTON_IDX_RUN] );
+            updateStartTime(now);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Calculate when the main loop has to wake up next for start times and housekeeping,
+ * sequence steps have a timer of their own
+ * ----------------------------------------------------------------------------------- */
+time_t nextDeadline(time_t now) {
+    // start times and housekeeping are checked on minute boundaries
+    time_t deadline = (now/60+1)*60;
+
+    // next automatic start, while it waits for a running sequence keep checking
+    if (systemMode == AUTOMATIC_MODE && nextStart) {
+        time_t next = nextStart > now ? nextStart : now+1;
+        if ( next < deadline ) {
+            deadline = next;
+        }
+    }
+    return deadline;
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Wall clock deadline reached: housekeeping and automatic start times
+ * ----------------------------------------------------------------------------------- */
+void checkClock(time_t now) {
+    static time_t lastTime = 0;
+    static int    lastHouseKeeping = 0;
+
+    if ( lastTime == now ) {
+        return;
+    }
+    if ( now < lastTime ) {
+        writeLog(LOG_NOTICE, "Clock went backwards, recalculating start time");
+        updateStartTime(now);
+    }
+    lastTime = now;
+    struct tm *timestamp = localtime(&now);
+    if ((timestamp->tm_min % 5 == 0) && timestamp->tm_hour != lastHouseKeeping) {
+        // do housekeeping every 5 minutes
+        lastHouseKeeping = timestamp->tm_hour;
+        houseKeeping();
+    }
+
+    if (systemMode == AUTOMATIC_MODE) {
+        checkStartTime(now);
+    }
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Run automatic mode for <days> days on the virtual clock, as fast as possible, and
+ * sum up what happened. Time jumps from one deadline to the next, the valve log
+ * carries simulated time stamps.
+ * ----------------------------------------------------------------------------------- */
+void simulate(int days) {
+    struct timespec start, end;
+    long   *openSeconds = calloc(config->numZones, sizeof(long));
+    int     starts = 0;
+    bool    running = false;
+    time_t  stop = clockWall() + (time_t)days*24*3600;
+
+    if ( !openSeconds ) {
+        writeLog(LOG_ERR, "Error: Out of memory.");
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ( systemMode != AUTOMATIC_MODE ) {
+        pushButtons[BUTTON_IDX_TIMER].state = true;
+        automaticMode( &pushButtons[BUTTON_IDX_TIMER] );
+    }
+
+    while ( clockWall() < stop ) {
+        time_t now  = clockWall();
+        time_t wake = nextDeadline(now) - now;
+        time_t step = schedulerNextDeadline();
+        if ( step && step - clockMono() < wake ) {
+            wake = step > clockMono() ? step - clockMono() : 0;
+        }
+        if ( wake > stop - now ) {
+            wake = stop - now;
+        }
+        for ( int idx=0; idx<config->numZones; idx++ ) {
+            if ( pushButtons[BUTTON_IDX_ZONE+idx].state ) {
+                openSeconds[idx] += wake;
+            }
+        }
+        clockAdvance(wake);
+
+        checkClock(clockWall());
+        processSequence();
+        if ( sequenceInProgress && !running ) {
+            starts++;
+        }
+        running = sequenceInProgress;
+        hwFlush();
+        syncState(clockMono());
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    long usec = (end.tv_sec - start.tv_sec)*1000000L + (end.tv_nsec - start.tv_nsec)/1000;
+    printf("# Simulated %d days in %ld us: %d sequence starts\n", days, usec, starts);
+    for ( int idx=0; idx<config->numZones; idx++ ) {
+        printf("# Zone %-16s %6ld min open\n", config->zones[idx].name, openSeconds[idx]/60);
+    }
+    free(openSeconds);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * Feed a trace recorded with -R through the control loop again, as fast as possible.
+ * Clock and inputs are taken from the trace, every change of a button or valve is
+ * printed as line "+<seconds since start> <button> ON|OFF", so two runs can be diffed.
+ * ----------------------------------------------------------------------------------- */
+void replay(const char *fileName) {
+    traceHeader_t   header;
+    traceEvent_t    event;
+    struct timespec start, end;
+    char            topic[MQTT_TOPIC_LEN];
+    char            payload[MQTT_PAYLOAD_LEN];
+    long            events = 0;
+    bool           *shown  = calloc(numButtons, sizeof(bool));
+    int             shownSequence = activeSequence;
+
+    if ( !shown || !traceLoad(fileName, &header) ) {
+        free(shown);
+        exit(1);
+    }
+    if ( header.numButtons != numButtons ) {
+        writeLog(LOG_ERR, "Error: trace has %d buttons, configuration %d", header.numButtons, numButtons);
+        exit(1);
+    }
+    clockSetVirtual((time_t)header.wall);
+    setupIO();
+    mqttIncoming_t *subscriptions = commandSubscriptions();
+    if ( !subscriptions ) {
+        exit(1);
+    }
+    mqttSetHandlers(subscriptions);
+    for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
+        shown[btnIndex] = pushButtons[btnIndex].state;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ( traceNext(&event) ) {
+        const traceRecord_t *rec = &event.record;
+
+        // clock as it was when the event happened
+        clockAdvance((time_t)(VIRTUAL_MONO_BASE + rec->mono) - clockMono());
+        clockStep((time_t)(header.wall + rec->wall) - clockWall());
+
+        switch ( rec->type ) {
+        case TRACE_START:
+            activateSequence( rec->index < config->numPrograms ? rec->index : 0 );
+            if ( rec->value == AUTOMATIC_MODE ) {
+                pushButtons[BUTTON_IDX_TIMER].state = true;
+                automaticMode( &pushButtons[BUTTON_IDX_TIMER] );
+            }
+            break;
+        case TRACE_BUTTON:
+            if ( rec->index < numButtons && pushButtons[rec->index].btnPin >= 0 ) {
+                pushbutton_t *button = &pushButtons[rec->index];
+                readButton(button, pushButtons, numButtons, rec->value ? hwPinMask(button->btnPin) : 0);
+            }
+            break;
+        case TRACE_MQTT:
+            if ( rec->topicLen < sizeof(topic) && rec->payloadLen < sizeof(payload) ) {
+                memcpy(topic, event.topic, rec->topicLen);
+                topic[rec->topicLen] = '\0';
+                memcpy(payload, event.payload, rec->payloadLen);
+                payload[rec->payloadLen] = '\0';
+                mqttDispatch(topic, payload, rec->payloadLen);
+            }
             break;
+        case TRACE_TICK:
+            if ( rec->value & EV_STEP ) {
+                processSequence();
+            }
+            if ( rec->value & EV_DEADLINE ) {
+                checkClock(clockWall());
+            }
+            break;
+        }
+        hwFlush();
+        events++;
+
+        // timeline of everything that changed
+        for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
+            if ( pushButtons[btnIndex].state != shown[btnIndex] ) {
+                shown[btnIndex] = pushButtons[btnIndex].state;
+                printf("+%u %s %s\n", rec->mono, pushButtons[btnIndex].name, shown[btnIndex] ? "ON" : "OFF");
+            }
+        }
+        if ( activeSequence != shownSequence ) {
+            shownSequence = activeSequence;
+            printf("+%u SEQUENCE %d\n", rec->mono, activeProgram() ? activeProgram()->id : 0);
         }
-        step++;
     }
-    
-    // end of sequence reached?
-    if (sequence[activeSequence][step].offset < 0) {
-        pushButtons[5].state=false;                 // simulate sequence button press
-        startSequence( &pushButtons[5] );
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    long usec = (end.tv_sec - start.tv_sec)*1000000L + (end.tv_nsec - start.tv_nsec)/1000;
+    fprintf(stderr, "# Replayed %ld events in %ld us, %.0f events/s\n",
+            events, usec, usec > 0 ? events*1e6/usec : 0.0);
+    traceUnload();
+    free(shown);
+}
+
+/* ----------------------------------------------------------------------------------- *
+ * One subscription for all buttons: <command prefix>/+, NULL if out of memory
+ * ----------------------------------------------------------------------------------- */
+mqttIncoming_t *commandSubscriptions( void ) {
+    static mqttIncoming_t subscriptions[] = {
+        {NULL, &pressButtonCB, NULL},
+        {NULL, NULL, NULL},
+    };
+    if ( !subscriptions[0].topic ) {
+        char *commandTopic = malloc(strlen(mqttBroker.command)+3);
+        if ( !commandTopic ) {
+            writeLog(LOG_ERR, "Error: Out of memory.");
+            return NULL;
+        }
+        sprintf(commandTopic, "%s/+", mqttBroker.command);
+        subscriptions[0].topic     = commandTopic;
+        subscriptions[0].user_data = pushButtons;
     }
+    return subscriptions;
 }
 
 /* ----------------------------------------------------------------------------------- *
  * Setup IO ports
  * ----------------------------------------------------------------------------------- */
 void setupIO ( void ) {
-    // initialize wiring PI and attached IO extender
-    wiringPiSetup () ;
-    mcp23017Setup (PINBASE_0, ADDR_IOEXT_0);
-
-    // setup pin modes for buttons
-    int btnIndex = 0;    
-    while (pushButtons[btnIndex].btnPin >= 0 ) {
-        pinMode(pushButtons[btnIndex].btnPin, INPUT);
-        pullUpDnControl (pushButtons[btnIndex].btnPin, PUD_UP) ;
-        pinMode(pushButtons[btnIndex].ledPin, OUTPUT);
-        digitalWrite(pushButtons[btnIndex].ledPin,
-                     pushButtons[btnIndex].state ? HIGH : LOW );
-        btnIndex++;
-    }
-
-    pinMode(LED_S0, OUTPUT);
-    pinMode(LED_S1, OUTPUT);
-
-    digitalWrite (LED_S0, HIGH);
-    digitalWrite (LED_S1, LOW);
+    // initialize attached IO extender
+    hwSetup (hwBackend, PINBASE_0, expanders, numExpanders);
+
+    // setup pin modes for buttons, zones may come without one
+    for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
+        if ( pushButtons[btnIndex].btnPin >= 0 ) {
+            hwPinMode(pushButtons[btnIndex].btnPin, INPUT);
+            hwPullUpDn (pushButtons[btnIndex].btnPin, PUD_UP) ;
+        }
+        hwPinMode(pushButtons[btnIndex].ledPin, OUTPUT);
+        hwDigitalWrite(pushButtons[btnIndex].ledPin,
+                       pushButtons[btnIndex].state ? HIGH : LOW );
+    }
+
+    hwPinMode(LED_S0, OUTPUT);
+    hwPinMode(LED_S1, OUTPUT);
+
+    hwDigitalWrite (LED_S0, HIGH);
+    hwDigitalWrite (LED_S1, LOW);
+    hwFlush();
 }
 
 /* ----------------------------------------------------------------------------------- *
@@ -326,20 +853,21 @@ void setupIO ( void ) {
  * ----------------------------------------------------------------------------------- */
 void houseKeeping(void) {
     writeLog(LOG_INFO, "Do housekeeping");
+    writeLog(LOG_DEBUG, "%lu I2C transactions so far", atomic_load(&hwTransactions));
 
-    // publish Status of all buttons
-    int btnIndex = 0;
-    while ( pushButtons[btnIndex].btnPin >= 0 ) {
-        publishStatus(&pushButtons[btnIndex]);
-        btnIndex++;
-    }
+    // button states are published as retained messages, no need to repeat them here
 }
 
 /* ----------------------------------------------------------------------------------- *
- * Main
+ * Main, left out when linked into the benchmarks and tests
  * ----------------------------------------------------------------------------------- */
+#ifndef YARDCONTROL_BENCH
 int main( int argc, char *argv[] ) {
-    bool dumpConfig = false;
+    bool dumpOnly = false;
+    bool optimize = false;
+    int  simulateDays = 0;
+    char *recordFile  = NULL;
+    char *replayFile  = NULL;
     
     // Process command line options
     for (int i=0; i<argc; i++) {
@@ -353,7 +881,28 @@ int main( int argc, char *argv[] ) {
             foreground=true;
         }
         if (!strcmp(argv[i], "-n")) {          // '-n' dont start read config and dump result
-            dumpConfig=true;
+            dumpOnly=true;
+        }
+        if (!strcmp(argv[i], "-o")) {          // '-o' reorder sequences for the shortest run, dump result
+            dumpOnly=true;
+            optimize=true;
+        }
+        if (!strcmp(argv[i], "-s")) {          // '-s' use simulated IO extender
+            hwBackend=&hwSimulator;
+        }
+        if (!strcmp(argv[i], "-S") && i+1<argc) {  // '-S <days>' run automatic mode on a virtual clock
+            simulateDays = atoi(argv[++i]);
+            hwBackend    = &hwSimulator;
+            foreground   = true;
+            debug++;                           // show valve switches
+        }
+        if (!strcmp(argv[i], "-R") && i+1<argc) {  // '-R <file>' record inputs to trace file
+            recordFile = argv[++i];
+        }
+        if (!strcmp(argv[i], "-P") && i+1<argc) {  // '-P <file>' replay trace file, print timeline
+            replayFile = argv[++i];
+            hwBackend  = &hwSimulator;
+            foreground = true;
         }
     }
     
@@ -362,7 +911,13 @@ int main( int argc, char *argv[] ) {
     setLogLevel(LOG_NOTICE+debug);
     
     // read configuration from file
-    readConfig();
+    if ( !readConfig() && !config ) {
+        writeLog(LOG_ERR, "Can't use %s, exiting", configFile);
+        exit(1);
+    }
+    if ( !setupButtons() ) {
+        exit(1);
+    }
     
     if (!foreground) {
         // run in background
@@ -370,88 +925,148 @@ int main( int argc, char *argv[] ) {
     } else {
         writeLog(LOG_NOTICE, "Running in foreground");
     }
+
+    // threads don't survive daemonize(), start log thread afterwards
+    if (asyncLog && !dumpOnly && !simulateDays && !replayFile) {
+        startLogThread();
+    }
     
-    if ( dumpConfig ) {
+    if ( dumpOnly ) {
         // dump configuration
-        dumpSequence( 0 );
-        dumpSequence( 1 );
+        if ( optimize ) {
+            optimizeConfig(config);
+        }
+        dumpConfig();
+        exit(1);
+    }
+
+    if ( simulateDays > 0 || replayFile ) {
+        // start with the sequence selected, but keep state of the simulated run apart
+        program_t *program = findProgram( (int)readStateInt("sequence", 0) );
+        char stateTemp[] = "/tmp/yardControl.XXXXXX";
+        if ( !mkdtemp(stateTemp) ) {
+            writeLog(LOG_ERR, "Can't create state directory for simulation, exiting");
+            exit(1);
+        }
+        stateDir = strdup(stateTemp);
+        writeLog(LOG_NOTICE, "Simulation state kept in %s", stateDir);
+
+        if ( replayFile ) {
+            replay(replayFile);              // trace sets sequence and mode
+            exit(0);
+        }
+        clockSetVirtual(clockWall());
+        setupIO();
+        activateSequence( program ? (int)(program - config->programs) : 0 );
+        simulate(simulateDays);
+        exit(0);
+    }
+
+    // set up event sources, needs to be done before the MQTT thread is started
+    if (!eventLoopInit(samplePeriod)) {
+        writeLog(LOG_ERR, "Can't set up event loop, exiting");
         exit(1);
     }
 
     // initialize MQTT connection to broker
     if (mqttBroker.address) {
-        mqttIncoming_t subscriptions[] = {
-            {"/YardControl/Command/Valve_A", &pressButtonCB, (void*)&pushButtons[0]},
-            {"/YardControl/Command/Valve_B", &pressButtonCB, (void*)&pushButtons[1]},
-            {"/YardControl/Command/Valve_C", &pressButtonCB, (void*)&pushButtons[2]},
-            {"/YardControl/Command/Valve_D", &pressButtonCB, (void*)&pushButtons[3]},
-            {"/YardControl/Command/Valve_S", &pressButtonCB, (void*)&pushButtons[4]},
-            {"/YardControl/Command/Valve_R", &pressButtonCB, (void*)&pushButtons[5]},
-            {"/YardControl/Command/Valve_P", &pressButtonCB, (void*)&pushButtons[6]},
-            {NULL, NULL, NULL},
-        };
-        
+        publisherInit(pushButtons, numButtons, mqttBroker.prefix);
+
+        mqttIncoming_t *subscriptions = commandSubscriptions();
+        if ( !subscriptions ) {
+            exit(1);
+        }
+        mqttSetNotify(&eventLoopWakeup);         // messages are handled in the main loop
         if (mqttInit(mqttBroker.address, mqttBroker.port, mqttBroker.keepalive, subscriptions)) {
             writeLog(LOG_INFO, "Connected MQTT boker at %s:%d", mqttBroker.address, mqttBroker.port);
         }
     }
 
+    // record from here on, the trace starts with sequence and mode set up below
+    if ( recordFile && !traceOpen(recordFile, numButtons) ) {
+        exit(1);
+    }
+
     // Initialize IO ports
     setupIO();
+    setDebounce(pressSamples, releaseSamples);
+
+    // find out if a sequence was interrupted, before the mode setup below stops it
+    journal_t journal;
+    journalRead(&journal);
 
-    // restore sequence setting
-    pushButtons[BUTTON_IDX_SELECT].state = readState("sequence");
-    selectSequence( &pushButtons[BUTTON_IDX_SELECT] );
+    // restore sequence setting, saved as SEQUENCE id
+    program_t *program = findProgram( (int)readStateInt("sequence", 0) );
+    activateSequence( program ? (int)(program - config->programs) : 0 );
     
     if (systemMode == AUTOMATIC_MODE) {
         writeLog(LOG_INFO, "Starting up in automatic mode");
         pushButtons[BUTTON_IDX_TIMER].state = true;
         automaticMode( &pushButtons[BUTTON_IDX_TIMER] );
     }
+
+    traceStart(activeSequence, systemMode);
+
+    // continue interrupted sequence
+    resumeSequence(&journal, clockWall());
     
     // publish Status of all buttons
-    int btnIndex = 0;
-    while ( pushButtons[btnIndex].btnPin >= 0 ) {
+    for ( int btnIndex=0; btnIndex<numButtons; btnIndex++ ) {
         publishStatus(&pushButtons[btnIndex]);
-        btnIndex++;
     }
     
+    hwFlush();
+    publisherFlush();
+
     // Main loop
-    time_t lastTime = 0;
-    int    lastHouseKeeping = 0;
+    eventLoopSetDeadline(clockWall()+1);
+    eventLoopSetStep(schedulerNextDeadline());
     for ( ;; ) {                                 // never stop working
-        time_t now = time(NULL);
-
-        if ( lastTime != now ) {                 // only work do once a second
-            lastTime = now;
-            struct tm *timestamp = localtime(&now);
-            if ((timestamp->tm_min % 5 == 0) && timestamp->tm_hour != lastHouseKeeping) {
-                // do housekeeping every 5 minutes
-                lastHouseKeeping = timestamp->tm_hour;
-                houseKeeping();
-            }
-    
-            if (systemMode == AUTOMATIC_MODE) {
-                int timeIdx=0;
-                while(startTime[activeSequence][timeIdx].tm_hour >= 0 ) {
-                    if ( timestamp->tm_hour == startTime[activeSequence][timeIdx].tm_hour
-                        && timestamp->tm_min == startTime[activeSequence][timeIdx].tm_min
-                        && !sequenceInProgress ) {
-                        writeLog( LOG_INFO, "Autostart sequence %02d", activeSequence );
-                        pushButtons[5].state=true;              // simulate sequence button press
-                        startSequence( &pushButtons[5] );
-                    }
-                    timeIdx++;
-                }
-            }
-            
-            if (sequenceInProgress) {         // forward sequence
-                processSequence();
+        int  signal  = 0;
+        bool changed = false;
+        int  events  = eventLoopWait(&signal);  // sleep until there is something to do
+
+        if ( events & EV_SIGNAL ) {
+            if ( signal == SIGHUP ) {
+                reloadSequences();            // start times may have changed
+                changed = true;
+            } else {
+                signalCB(signal);
             }
         }
-        
-        pollButtons(pushButtons);             // poll bush buttons
-        delay(50);                            // have a rest
+
+        if ( events & EV_SAMPLE ) {
+            changed |= pollButtons(pushButtons, numButtons);  // poll bush buttons
+        }
+
+        if ( events & EV_WAKEUP ) {
+            changed |= mqttProcessIncoming() > 0; // commands received over MQTT
+        }
+
+        if ( events & (EV_STEP|EV_DEADLINE) ) {
+            traceTick(events & (EV_STEP|EV_DEADLINE));
+        }
+
+        if ( events & EV_STEP ) {
+            processSequence();                // forward sequence, switch off timed valves
+        }
+
+        time_t now = clockWall();
+        if ( events & EV_DEADLINE ) {
+            checkClock(now);                  // housekeeping and start times
+        }
+
+        if ( changed || (events & EV_DEADLINE) ) {
+            eventLoopSetDeadline(nextDeadline(now));
+        }
+        eventLoopSetStep(schedulerNextDeadline());  // sequence may have started, stopped or moved on
+
+        hwFlush();                            // write valve and LED changes in one go
+        publisherFlush();                     // publish changed button states
+        traceFlush();                         // write recorded events
+        syncState(clockMono());               // write persistent state when due
+
     }
     return 0;
 }
+#endif /* YARDCONTROL_BENCH */
@@ -16,12 +16,14 @@
 /*  along with this program.  If not, see <http://www.gnu.org/licenses/>.              */
 /* *********************************************************************************** */
 #include "pushButton.h"
+#include "hardware.h"
 
 #ifndef yardControl_h
 #define yardControl_h
 /* ----------------------------------------------------------------------------------- *
  * MPC23017 IO extender
  * ----------------------------------------------------------------------------------- */
+#define I2C_BUS_0         1   // /dev/i2c-1
 #define ADDR_IOEXT_0   0x20
 #define PINBASE_0        64
 
@@ -53,6 +55,7 @@
 #define BUTTON_AUTO   PINBASE_0+13  // toggle automatic mode
 #define BUTTON_SELECT PINBASE_0+14  // select between sequence 1 and 2
 #define NC_1_7        PINBASE_0+15  // not connected
+#define NUM_PINS      HW_CHIP_PINS  // pins per IO extender
 
 /* ----------------------------------------------------------------------------------- *
  * radio groups for bush buttons
@@ -74,11 +77,19 @@
 #define MANUAL_MODE    0
 #define AUTOMATIC_MODE 1
 
+/* ----------------------------------------------------------------------------------- *
+ * How to continue a sequence interrupted by a restart
+ * ----------------------------------------------------------------------------------- */
+#define RESUME_OFF     0         // don't, wait for next start
+#define RESUME_OFFSET  1         // keep original timing, overdue steps run at once
+#define RESUME_STEP    2         // continue with next step, shifting the timing
+
 /* ----------------------------------------------------------------------------------- *
  * export some globals
  * ----------------------------------------------------------------------------------- */
 extern int systemMode;
-extern pushbutton_t pushButtons[];
+extern pushbutton_t *pushButtons;
+extern int numButtons;
 extern int debug;
 
 #endif /* yardControl_h */